@@ -0,0 +1,499 @@
+#include "multiarray.h"
+#include "multiarray_fixed.h"
+#include "multiarray_blocked.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+
+//Self-contained microbenchmarks: every case runs until it has taken at least
+//min_time, the best of several such runs is reported per element (or per
+//operation) next to the raw pointer baseline of the same shape.
+//Usage: multiarray_bench [filter], runs only cases whose name contains filter.
+
+namespace benchutils {
+
+typedef unsigned long long int idx_t;
+
+const double min_time=0.05;
+const int repeats=5;
+
+//keeps results alive without the compiler seeing through them
+template<typename T>
+inline void keep(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink=value;
+#endif
+}
+
+inline void clobber() {
+#if defined(__GNUC__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+//seconds per call of f, best of repeats
+template<typename F>
+double measure(F f) {
+    typedef std::chrono::steady_clock clock;
+    f();
+    double best=1e300;
+    for(int r=0; r<repeats; ++r) {
+        idx_t calls=0;
+        auto start=clock::now();
+        double elapsed;
+        do {
+            f();
+            ++calls;
+            elapsed=std::chrono::duration<double>(clock::now()-start).count();
+        } while(elapsed<min_time);
+        best=std::min(best,elapsed/calls);
+    }
+    return best;
+}
+
+template<typename T> const char* name() { return typeid(T).name(); }
+template<> const char* name<int>() { return "int"; }
+template<> const char* name<float>() { return "float"; }
+template<> const char* name<double>() { return "double"; }
+
+template<std::size_t N>
+std::string shape(const std::array<unsigned int,N>& size) {
+    std::string s;
+    for(std::size_t j=0; j<N; ++j)
+        s+=(j ? "x" : "")+std::to_string(size[j]);
+    return s;
+}
+
+class report
+{
+    std::string filter;
+    std::string group;
+    double baseline;
+public:
+    explicit report(const std::string& filter) : filter(filter), baseline(0) {
+        std::cout<<std::left<<std::setw(28)<<"case"<<std::setw(8)<<"type"<<std::setw(16)<<"shape"
+                 <<std::right<<std::setw(12)<<"ns/elem"<<std::setw(10)<<"x raw"<<std::endl;
+    }
+
+    bool enabled(const std::string& bench) const {
+        return filter.empty() || bench.find(filter)!=std::string::npos;
+    }
+
+    //time f, which touches n elements per call
+    template<typename F>
+    void run(const std::string& bench, const std::string& type, const std::string& dims, idx_t n, F f, bool is_baseline=false) {
+        if(group!=type+dims) {
+            group=type+dims;
+            baseline=0;
+        }
+        if(!is_baseline && !enabled(bench))
+            return;
+        double ns=measure(f)*1e9/n;
+        if(is_baseline)
+            baseline=ns;
+        if(!enabled(bench))
+            return;
+        std::cout<<std::left<<std::setw(28)<<bench<<std::setw(8)<<type<<std::setw(16)<<dims
+                 <<std::right<<std::fixed<<std::setprecision(3)<<std::setw(12)<<ns;
+        if(baseline>0)
+            std::cout<<std::setprecision(2)<<std::setw(10)<<ns/baseline;
+        std::cout<<std::endl;
+    }
+};
+
+template<typename A, typename I, unsigned int ... S>
+inline auto get_args(const A& a, const I& idx, sequtils::seq<S...>) -> decltype(a.get(idx[S]...)) {
+    return a.get(idx[S]...);
+}
+
+template<typename A, typename I, typename T, unsigned int ... S>
+inline void set_args(A& a, const I& idx, T value, sequtils::seq<S...>) {
+    a(idx[S]...)=value;
+}
+
+//calls f(idx) over every multi-index in row-major order, the last index
+//runs in a plain inner loop so stepping does not dominate
+template<std::size_t N, typename F>
+inline void for_index(const std::array<unsigned int,N>& size, F f) {
+    std::array<unsigned int,N> idx{{0}};
+    for(;;) {
+        for(idx[N-1]=0; idx[N-1]<size[N-1]; ++idx[N-1])
+            f(idx);
+        std::size_t j=N-1;
+        for(; j-->0;) {
+            if(++idx[j]<size[j])
+                break;
+            idx[j]=0;
+        }
+        if(j==std::size_t(-1))
+            return;
+    }
+}
+
+template<typename T, unsigned int ndim>
+void access(report& out, const std::array<unsigned int,ndim>& size) {
+    typedef MultiArray<T,ndim> array_t;
+    typedef typename sequtils::gens<ndim>::type seq_t;
+    const std::string type=name<T>(), dims=shape(size);
+    array_t a=make_array<T>(size);
+    {
+        T v=T(0);
+        for(auto &x : a)
+            x=v++;
+    }
+    const array_t& ca=a;
+    const idx_t n=a.flat_size();
+
+    out.run("raw pointer sum",type,dims,n,[&] {
+        const T* p=ca.data();
+        T s=T(0);
+        for(idx_t i=0; i<n; ++i)
+            s+=p[i];
+        keep(s);
+    },true);
+    out.run("get(args...)",type,dims,n,[&] {
+        T s=T(0);
+        for_index(size,[&](const std::array<unsigned int,ndim>& idx) { s+=get_args(ca,idx,seq_t()); });
+        keep(s);
+    });
+    out.run("get(multiIdx_t)",type,dims,n,[&] {
+        T s=T(0);
+        for_index(size,[&](const std::array<unsigned int,ndim>& idx) { s+=ca.get(idx); });
+        keep(s);
+    });
+    out.run("at_unchecked(multiIdx_t)",type,dims,n,[&] {
+        T s=T(0);
+        for_index(size,[&](const std::array<unsigned int,ndim>& idx) { s+=ca.at_unchecked(idx); });
+        keep(s);
+    });
+    out.run("raw pointer write",type,dims,n,[&] {
+        T* p=a.data();
+        for(idx_t i=0; i<n; ++i)
+            p[i]=T(i&0xff);
+        clobber();
+    },true);
+    out.run("set operator()(args...)",type,dims,n,[&] {
+        T v=T(0);
+        for_index(size,[&](const std::array<unsigned int,ndim>& idx) { set_args(a,idx,v++,seq_t()); });
+        clobber();
+    });
+    out.run("set(multiIdx_t)",type,dims,n,[&] {
+        T v=T(0);
+        for_index(size,[&](const std::array<unsigned int,ndim>& idx) { a.set(idx)=v++; });
+        clobber();
+    });
+}
+
+template<typename T, unsigned int ndim>
+void iteration(report& out, const std::array<unsigned int,ndim>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    const MultiArray<T,ndim> a=make_array<T>(size);
+    const idx_t n=a.flat_size();
+
+    out.run("raw pointer sum",type,dims,n,[&] {
+        const T* p=a.data();
+        T s=T(0);
+        for(idx_t i=0; i<n; ++i)
+            s+=p[i];
+        keep(s);
+    },true);
+    out.run("const_iterator",type,dims,n,[&] {
+        T s=T(0);
+        for(auto i=a.const_begin(); i!=a.const_end(); ++i)
+            s+=*i;
+        keep(s);
+    });
+    out.run("range-for",type,dims,n,[&] {
+        T s=T(0);
+        for(auto &x : a)
+            s+=x;
+        keep(s);
+    });
+    MultiArray<T,ndim> w=a;
+    out.run("iterator",type,dims,n,[&] {
+        T s=T(0);
+        for(auto i=w.begin(); i!=w.end(); ++i)
+            s+=*i;
+        keep(s);
+    });
+    out.run("iterator write",type,dims,n,[&] {
+        T v=T(0);
+        for(auto &x : w)
+            x=v++;
+        clobber();
+    });
+    out.run("iterator index()",type,dims,n,[&] {
+        unsigned int s=0;
+        for(auto i=a.const_begin(); i!=a.const_end(); ++i)
+            s+=i.index()[ndim-1];
+        keep(s);
+    });
+    out.run("nd_iterator index()",type,dims,n,[&] {
+        unsigned int s=0;
+        for(auto i=a.const_nd_begin(); i!=a.const_nd_end(); ++i)
+            s+=i.index()[ndim-1];
+        keep(s);
+    });
+}
+
+//std::sort through the random-access iterators, each call sorts a fresh copy
+template<typename T>
+void sorting(report& out, unsigned int size) {
+    const std::string type=name<T>(), dims=std::to_string(size);
+    MultiArray<T,1> src(size), a(size);
+    unsigned int r=1;
+    for(auto &x : src)
+        x=T((r=r*1664525u+1013904223u)>>8);
+    std::vector<T> raw(src.const_begin(),src.const_end());
+    const idx_t n=size;
+
+    out.run("raw pointer std::sort",type,dims,n,[&] {
+        std::copy(src.const_begin(),src.const_end(),raw.begin());
+        std::sort(raw.data(),raw.data()+n);
+        clobber();
+    },true);
+    out.run("iterator std::sort",type,dims,n,[&] {
+        std::copy(src.const_begin(),src.const_end(),a.begin());
+        std::sort(a.begin(),a.end());
+        clobber();
+    });
+}
+
+template<typename T, unsigned int ndim>
+void slicing(report& out, const std::array<unsigned int,ndim>& size);
+
+template<typename T>
+void slicing(report& out, const std::array<unsigned int,2>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    const MultiArray<T,2> a=make_array<T>(size);
+    const unsigned int rows=size[0], cols=size[1];
+
+    out.run("raw pointer column",type,dims,rows,[&] {
+        const T* p=a.data();
+        T s=T(0);
+        for(unsigned int i=0; i<rows; ++i)
+            s+=p[idx_t(i)*cols+cols/2];
+        keep(s);
+    },true);
+    out.run("slice(range(),j) column",type,dims,rows,[&] {
+        T s=T(0);
+        for(auto &x : a.slice(range(),cols/2))
+            s+=x;
+        keep(s);
+    });
+    out.run("slice(range(a,b),range())",type,dims,idx_t(rows/2)*cols,[&] {
+        T s=T(0);
+        for(auto &x : a.slice(range(rows/4,rows/4+rows/2-1),range()))
+            s+=x;
+        keep(s);
+    });
+    out.run("slice(i,range()) row",type,dims,cols,[&] {
+        T s=T(0);
+        for(auto &x : a.slice(rows/2,range()))
+            s+=x;
+        keep(s);
+    });
+    out.run("slice() creation only",type,dims,1,[&] {
+        auto v=a.slice(range(1,rows-2),range(1,cols-2));
+        keep(v.size());
+    });
+}
+
+template<typename T>
+void slicing(report& out, const std::array<unsigned int,3>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    const MultiArray<T,3> a=make_array<T>(size);
+    const idx_t plane=idx_t(size[1])*size[2];
+
+    out.run("raw pointer plane",type,dims,plane,[&] {
+        const T* p=a.data()+(size[0]/2)*plane;
+        T s=T(0);
+        for(idx_t i=0; i<plane; ++i)
+            s+=p[i];
+        keep(s);
+    },true);
+    out.run("slice(i,range(),range())",type,dims,plane,[&] {
+        T s=T(0);
+        for(auto &x : a.slice(size[0]/2,range(),range()))
+            s+=x;
+        keep(s);
+    });
+    out.run("slice(range(),range(),k)",type,dims,idx_t(size[0])*size[1],[&] {
+        T s=T(0);
+        for(auto &x : a.slice(range(),range(),size[2]/2))
+            s+=x;
+        keep(s);
+    });
+}
+
+template<typename T, unsigned int ndim>
+void copying(report& out, const std::array<unsigned int,ndim>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    MultiArray<T,ndim> a=make_array<T>(size);
+    for(auto &x : a)
+        x=T(1);
+    const idx_t n=a.flat_size();
+    MultiArray<T,ndim> dst=make_array<T>(size);
+
+    out.run("raw memcpy",type,dims,n,[&] {
+        std::memcpy(dst.data(),a.data(),n*sizeof(T));
+        clobber();
+    },true);
+    out.run("copy ctor (shared)",type,dims,n,[&] {
+        MultiArray<T,ndim> c(a);
+        keep(c.flat_size());
+    });
+    out.run("copy + cow detach",type,dims,n,[&] {
+        MultiArray<T,ndim> c(a);
+        c.reserve_unique();
+        keep(c.data());
+    });
+    out.run("view().copy()",type,dims,n,[&] {
+        auto c=a.view().copy();
+        keep(c.flat_size());
+    });
+    out.run("transpose().copy()",type,dims,n,[&] {
+        auto c=a.transpose().copy();
+        keep(c.flat_size());
+    });
+    out.run("move ctor + assign",type,dims,n,[&] {
+        MultiArray<T,ndim> c(std::move(a));
+        a=std::move(c);
+        keep(a.flat_size());
+    });
+}
+
+//3x3 convolution, the kernel held in a raw array, a MultiArray and a FixedMultiArray
+template<typename T>
+void kernel(report& out, const std::array<unsigned int,2>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    const unsigned int rows=size[0], cols=size[1];
+    MultiArray<T,2> img=make_array<T>(size);
+    {
+        T v=T(0);
+        for(auto &x : img)
+            x=v++;
+    }
+    const MultiArray<T,2>& cimg=img;
+    const idx_t n=idx_t(rows-2)*(cols-2);
+    T raw[9];
+    MultiArray<T,2> heap(3u,3u);
+    FixedMultiArray<T,3,3> fixed;
+    for(unsigned int i=0; i<9; ++i)
+        raw[i]=heap(i/3,i%3)=fixed(i/3,i%3)=T(i+1);
+    const MultiArray<T,2>& cheap=heap;
+    const FixedMultiArray<T,3,3>& cfixed=fixed;
+
+    out.run("raw kernel 3x3",type,dims,n,[&] {
+        const T* p=cimg.data();
+        T s=T(0);
+        for(unsigned int y=1; y+1<rows; ++y)
+            for(unsigned int x=1; x+1<cols; ++x)
+                for(unsigned int i=0; i<3; ++i)
+                    for(unsigned int j=0; j<3; ++j)
+                        s+=raw[i*3+j]*p[idx_t(y+i-1)*cols+x+j-1];
+        keep(s);
+    },true);
+    out.run("MultiArray kernel 3x3",type,dims,n,[&] {
+        const T* p=cimg.data();
+        T s=T(0);
+        for(unsigned int y=1; y+1<rows; ++y)
+            for(unsigned int x=1; x+1<cols; ++x)
+                for(unsigned int i=0; i<3; ++i)
+                    for(unsigned int j=0; j<3; ++j)
+                        s+=cheap(i,j)*p[idx_t(y+i-1)*cols+x+j-1];
+        keep(s);
+    });
+    out.run("FixedMultiArray kernel 3x3",type,dims,n,[&] {
+        const T* p=cimg.data();
+        T s=T(0);
+        for(unsigned int y=1; y+1<rows; ++y)
+            for(unsigned int x=1; x+1<cols; ++x)
+                for(unsigned int i=0; i<3; ++i)
+                    for(unsigned int j=0; j<3; ++j)
+                        s+=cfixed(i,j)*p[idx_t(y+i-1)*cols+x+j-1];
+        keep(s);
+    });
+}
+
+//3-D sweep with the first index running fastest, the worst order for row-major
+template<typename T>
+void blocked(report& out, const std::array<unsigned int,3>& size) {
+    const std::string type=name<T>(), dims=shape(size);
+    MultiArray<T,3> a=make_array<T>(size);
+    for(auto &x : a)
+        x=T(1);
+    const MultiArray<T,3>& ca=a;
+    const BlockedMultiArray<T,3> b(a);
+    const idx_t n=a.flat_size();
+
+    out.run("raw pointer dim 0 sweep",type,dims,n,[&] {
+        const T* p=ca.data();
+        T s=T(0);
+        for(unsigned int k=0; k<size[2]; ++k)
+            for(unsigned int j=0; j<size[1]; ++j)
+                for(unsigned int i=0; i<size[0]; ++i)
+                    s+=p[(idx_t(i)*size[1]+j)*size[2]+k];
+        keep(s);
+    },true);
+    out.run("MultiArray dim 0 sweep",type,dims,n,[&] {
+        T s=T(0);
+        for(unsigned int k=0; k<size[2]; ++k)
+            for(unsigned int j=0; j<size[1]; ++j)
+                for(unsigned int i=0; i<size[0]; ++i)
+                    s+=ca.at_unchecked(i,j,k);
+        keep(s);
+    });
+    out.run("Blocked dim 0 sweep",type,dims,n,[&] {
+        T s=T(0);
+        for(unsigned int k=0; k<size[2]; ++k)
+            for(unsigned int j=0; j<size[1]; ++j)
+                for(unsigned int i=0; i<size[0]; ++i)
+                    s+=b.at_unchecked({{i,j,k}});
+        keep(s);
+    });
+    out.run("Blocked for_each_chunk",type,dims,n,[&] {
+        T s=T(0);
+        b.for_each_chunk([&](const std::array<unsigned int,3>&, const std::array<unsigned int,3>& ext, const T* p) {
+            for(unsigned int i=0; i<ext[0]; ++i)
+                for(unsigned int j=0; j<ext[1]; ++j)
+                    for(unsigned int k=0; k<ext[2]; ++k)
+                        s+=p[i*b.chunk_stride(0)+j*b.chunk_stride(1)+k];
+        });
+        keep(s);
+    });
+}
+
+template<typename T>
+void run_type(report& out) {
+    access<T,1>(out,{{1u<<20}});
+    access<T,2>(out,{{1024,1024}});
+    access<T,3>(out,{{64,128,128}});
+    access<T,4>(out,{{16,16,64,64}});
+    iteration<T,1>(out,{{1u<<20}});
+    iteration<T,2>(out,{{1024,1024}});
+    iteration<T,3>(out,{{64,128,128}});
+    sorting<T>(out,1u<<20);
+    slicing<T>(out,std::array<unsigned int,2>{{1024,1024}});
+    slicing<T>(out,std::array<unsigned int,3>{{64,128,128}});
+    copying<T,2>(out,{{1024,1024}});
+    copying<T,3>(out,{{64,128,128}});
+    kernel<T>(out,{{512,512}});
+    blocked<T>(out,{{256,256,256}});
+}
+}
+
+int main(int argc, char** argv)
+{
+    benchutils::report out(argc>1 ? argv[1] : "");
+    benchutils::run_type<int>(out);
+    benchutils::run_type<float>(out);
+    benchutils::run_type<double>(out);
+}
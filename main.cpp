@@ -14,6 +14,15 @@ void test() {
     testinner(int(),args...);
     testinner(float(),args...);
     testinner(double(),args...);
+    test_fixed<int,args...>();
+    test_fixed<float,args...>();
+    test_fixed<double,args...>();
+    test_sparse<int,args...>();
+    test_sparse<float,args...>();
+    test_sparse<double,args...>();
+    test_blocked<int,args...>();
+    test_blocked<float,args...>();
+    test_blocked<double,args...>();
     std::cerr<<__PRETTY_FUNCTION__<<" test: Success!"<<std::endl;
 }
 
@@ -84,5 +93,9 @@ int main()
     for(auto &i : arr7)
         std::cout<<i<<" ";
     std::cout<<std::endl;
+    //slices are views sharing arr5's buffer, copy() makes an independent dense array
+    auto arr8=arr7.copy();
+    arr8(0,0)=-1;
+    std::cout<<"arr8(0,0)="<<arr8(0,0)<<", arr7(0,0)="<<arr7(0,0)<<std::endl;
 }
 
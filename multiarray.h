@@ -1,10 +1,14 @@
 #ifndef MULTIARRAY_H
 #define MULTIARRAY_H
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iterator>
 #include <memory>
 #include <array>
 #include <stdexcept>
+#include <tuple>
 #include <vector>
 
 namespace sequtils {
@@ -21,21 +25,350 @@ struct count_idx : count_idx<N+(std::is_integral<Ti>::value?1:0), Types...> {};
 
 template<unsigned int N, typename Ti>
 struct count_idx<N, Ti> { constexpr static unsigned int value=N+(std::is_integral<Ti>::value?1:0); };
+
+//axis permutation helpers
+
+template<unsigned int X, unsigned int ... A>
+struct contains : std::false_type {};
+
+template<unsigned int X, unsigned int A0, unsigned int ... A>
+struct contains<X, A0, A...> : std::integral_constant<bool,X==A0 || contains<X,A...>::value> {};
+
+template<unsigned int N, unsigned int ... A>
+struct is_permutation : std::true_type {};
+
+template<unsigned int N, unsigned int A0, unsigned int ... A>
+struct is_permutation<N, A0, A...> : std::integral_constant<bool,A0<N && !contains<A0,A...>::value && is_permutation<N,A...>::value> {};
+
+//bulk copies between strided or indexed regions, walked in row-major order
+
+typedef unsigned long long int idx_t;
+
+//dst[i*ds]=src[i*ss] over size; trailing dimensions contiguous on both sides
+//are merged into one run copied with std::copy (a memmove for trivial types)
+template<typename T, std::size_t N>
+void strided_copy(const T* src, const std::array<idx_t,N>& ss, T* dst, const std::array<idx_t,N>& ds, const std::array<unsigned int,N>& size) {
+    for(auto n : size)
+        if(!n)
+            return;
+    idx_t run=1;
+    std::size_t k=N;
+    for(; k>0 && (size[k-1]==1 || (ss[k-1]==run && ds[k-1]==run)); --k)
+        run*=size[k-1];
+    const std::size_t outer=k<N ? k : N-1;
+    const idx_t n=k<N ? run : size[N-1], si=k<N ? 1 : ss[N-1], di=k<N ? 1 : ds[N-1];
+    std::array<unsigned int,N> cur{{0}};
+    idx_t so=0, doff=0;
+    for(;;) {
+        if(si==1 && di==1)
+            std::copy(src+so,src+so+n,dst+doff);
+        else
+            for(idx_t i=0; i<n; ++i)
+                dst[doff+i*di]=src[so+i*si];
+        std::size_t j=outer;
+        for(; j-->0;) {
+            so+=ss[j];
+            doff+=ds[j];
+            if(++cur[j]<size[j])
+                break;
+            so-=cur[j]*ss[j];
+            doff-=cur[j]*ds[j];
+            cur[j]=0;
+        }
+        if(j==std::size_t(-1))
+            return;
+    }
+}
+
+//dst[dl[0][i0]+...]=src[sl[0][i0]+...], one offset list per dimension;
+//inner runs of consecutive offsets on both sides are copied whole
+template<typename T, std::size_t N>
+void indexed_copy(const T* src, const std::array<std::vector<idx_t>,N>& sl, T* dst, const std::array<std::vector<idx_t>,N>& dl) {
+    for(auto &l : sl)
+        if(l.empty())
+            return;
+    const std::vector<idx_t>& si=sl[N-1];
+    const std::vector<idx_t>& di=dl[N-1];
+    const idx_t n=si.size();
+    bool run=true;
+    for(idx_t i=1; i<n && run; ++i)
+        run=si[i]==si[0]+i && di[i]==di[0]+i;
+    std::array<std::size_t,N> cur{{0}};
+    for(;;) {
+        idx_t so=0, doff=0;
+        for(std::size_t j=0; j+1<N; ++j) {
+            so+=sl[j][cur[j]];
+            doff+=dl[j][cur[j]];
+        }
+        if(run)
+            std::copy(src+so+si[0],src+so+si[0]+n,dst+doff+di[0]);
+        else
+            for(idx_t i=0; i<n; ++i)
+                dst[doff+di[i]]=src[so+si[i]];
+        std::size_t j=N-1;
+        for(; j-->0;) {
+            if(++cur[j]<sl[j].size())
+                break;
+            cur[j]=0;
+        }
+        if(j==std::size_t(-1))
+            return;
+    }
+}
+
+//offsets i*stride for i<n
+inline std::vector<idx_t> offsets(unsigned int n, idx_t stride) {
+    std::vector<idx_t> l(n);
+    for(unsigned int i=0; i<n; ++i)
+        l[i]=i*stride;
+    return l;
+}
 }
 
-class range : public std::vector<unsigned int> {
+//Selection along one dimension: range() is the whole dimension, range(first,last)
+//and range(first,last,step) an inclusive span kept as three numbers, range{i,j,...}
+//an explicit index list, the only form that stores its indices.
+class range {
+    std::vector<unsigned int> list;
+    unsigned int mfirst;
+    std::size_t msize;
+    unsigned int mstep;
 public:
-    range(unsigned int first, unsigned int last) : std::vector<unsigned int>(last-first+1) {
-        for(unsigned int i=0; i<size(); ++i)
-            at(i)=i+first;
+    class const_iterator
+    {
+        const range* r;
+        std::size_t i;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef unsigned int value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const unsigned int* pointer;
+        typedef unsigned int reference;
+
+        const_iterator(const range* r, std::size_t i) : r(r), i(i) {}
+        unsigned int operator*() const { return (*r)[i]; }
+        const_iterator& operator++() { ++i; return *this; }
+        const_iterator operator++(int) { const_iterator old(*this); ++i; return old; }
+        bool operator==(const const_iterator& other) const { return i==other.i; }
+        bool operator!=(const const_iterator& other) const { return i!=other.i; }
+    };
+
+    range(unsigned int first, unsigned int last, unsigned int step=1) : mfirst(first), msize(0), mstep(step) {
+        //computed in std::size_t: in unsigned int, range(0,UINT_MAX) would wrap
+        //to 0, which means the whole dimension. Where std::size_t is no wider
+        //than unsigned int the same wrap is rejected instead.
+        if(last<first || !step || std::size_t((last-first)/step)==std::size_t(-1))
+            throw std::invalid_argument("Invalid MultiArray range");
+        msize=std::size_t((last-first)/step)+1;
+    }
+
+    range(std::initializer_list<unsigned int> list) : list(list), mfirst(0), msize(list.size()), mstep(1) {}
+
+    range() : mfirst(0), msize(0), mstep(1) {}
+
+    //whole dimension
+    bool empty() const {
+        return !msize;
+    }
+
+    //true unless this is an index list
+    bool strided() const {
+        return list.empty();
+    }
+
+    std::size_t size() const {
+        return msize;
+    }
+
+    unsigned int step() const {
+        return mstep;
+    }
+
+    unsigned int operator[](std::size_t i) const {
+        return list.empty() ? mfirst+unsigned(i)*mstep : list[i];
+    }
+
+    unsigned int front() const {
+        return (*this)[0];
+    }
+
+    unsigned int back() const {
+        return (*this)[msize-1];
     }
 
-    range(std::initializer_list<unsigned int> list) : std::vector<unsigned int>(list) {}
+    const_iterator begin() const {
+        return const_iterator(this,0);
+    }
 
-    range() : std::vector<unsigned int>() {}
+    const_iterator end() const {
+        return const_iterator(this,msize);
+    }
 };
 
 template<typename T, unsigned int ndim>
+class MultiArrayView;
+
+//copy-on-write policies, selected by the last MultiArray template parameter
+//implicit_cow: copies share the buffer, the first write through a shared copy detaches it
+//shared_mutable: copies share the buffer and see each other's writes, writes never check
+//explicit_clone: copies are deep, writes never check
+//reshape results follow the same rules as copies; views share the buffer
+//too, so they are snapshots only under implicit_cow
+//
+//implicit_cow is not safe when threads write to copies; use explicit_clone.
+//Its ownership test is a plain use_count() read, so two threads writing to
+//copies of one buffer can each see a count of 1 while the other is still
+//copying the old buffer, or write to a buffer the other still reads.
+struct implicit_cow {
+    constexpr static bool deep_copy=false;
+    constexpr static bool detach_on_write=true;
+};
+
+struct shared_mutable {
+    constexpr static bool deep_copy=false;
+    constexpr static bool detach_on_write=false;
+};
+
+struct explicit_clone {
+    constexpr static bool deep_copy=true;
+    constexpr static bool detach_on_write=false;
+};
+
+//Memory order of the axes, from the slowest to the fastest varying:
+//row_major is 0,1,...,ndim-1 (C), column_major is ndim-1,...,0 (Fortran).
+template<unsigned int ndim>
+class layout
+{
+    std::array<unsigned int,ndim> axes;
+
+    layout() {}
+public:
+    explicit layout(const std::array<unsigned int,ndim>& order) : axes(order) {
+        std::array<bool,ndim> seen{{}};
+        for(auto j : axes) {
+            if(j>=ndim || seen[j])
+                throw std::invalid_argument("Invalid MultiArray layout");
+            seen[j]=true;
+        }
+    }
+
+    static layout row_major() {
+        layout l;
+        for(unsigned int j=0; j<ndim; ++j)
+            l.axes[j]=j;
+        return l;
+    }
+
+    static layout column_major() {
+        layout l;
+        for(unsigned int j=0; j<ndim; ++j)
+            l.axes[j]=ndim-1-j;
+        return l;
+    }
+
+    inline const std::array<unsigned int,ndim>& order() const {
+        return axes;
+    }
+
+    bool operator==(const layout& other) const {
+        return axes==other.axes;
+    }
+
+    bool operator!=(const layout& other) const {
+        return axes!=other.axes;
+    }
+};
+
+namespace reduceutils {
+//axis reductions: with dense strides an array is an (outer,n,inner) block in
+//memory, n along the reduced axis, and the result is the dense (outer,inner)
+
+typedef unsigned long long int idx_t;
+
+//kept elements per pass over the reduced axis, small enough to stay in cache
+const idx_t tile=1024;
+
+template<unsigned int axis, std::size_t ndim>
+inline std::array<unsigned int,ndim-1> drop_size(const std::array<unsigned int,ndim>& size) {
+    std::array<unsigned int,ndim-1> r;
+    for(unsigned int j=0, k=0; j<ndim; ++j)
+        if(j!=axis)
+            r[k++]=size[j];
+    return r;
+}
+
+template<unsigned int axis, unsigned int ndim>
+inline layout<ndim-1> drop_layout(const layout<ndim>& l) {
+    std::array<unsigned int,ndim-1> order{{}};
+    unsigned int k=0;
+    for(auto j : l.order())
+        if(j!=axis)
+            order[k++]=j>axis ? j-1 : j;
+    return layout<ndim-1>(order);
+}
+
+//dst[i]=src[i] op src[inner+i] op ... for the result elements [first,last)
+template<typename T, typename Op>
+void fold(const T* src, T* dst, idx_t n, idx_t inner, idx_t first, idx_t last, Op& op) {
+    while(first<last) {
+        const idx_t o=first/inner, i0=first%inner, i1=last-o*inner<inner ? last-o*inner : inner;
+        const T* s=src+o*n*inner;
+        T* d=dst+o*inner;
+        if(inner==1) {
+            T acc=s[0];
+            for(idx_t k=1; k<n; ++k)
+                acc=op(acc,s[k]);
+            d[0]=acc;
+        } else {
+            for(idx_t b=i0; b<i1; b+=tile) {
+                const idx_t e=i1-b<tile ? i1 : b+tile;
+                for(idx_t i=b; i<e; ++i)
+                    d[i]=s[i];
+                for(idx_t k=1; k<n; ++k) {
+                    const T* row=s+k*inner;
+                    for(idx_t i=b; i<e; ++i)
+                        d[i]=op(d[i],row[i]);
+                }
+            }
+        }
+        first=o*inner+i1;
+    }
+}
+
+//position along the axis of the first element no later one is better than
+template<typename T, typename I, typename Cmp>
+void arg_fold(const T* src, I* dst, idx_t n, idx_t inner, idx_t first, idx_t last, Cmp& better) {
+    std::vector<T> best;
+    while(first<last) {
+        const idx_t o=first/inner, i0=first%inner, i1=last-o*inner<inner ? last-o*inner : inner;
+        const T* s=src+o*n*inner;
+        I* d=dst+o*inner;
+        for(idx_t b=i0; b<i1; b+=tile) {
+            const idx_t e=i1-b<tile ? i1 : b+tile;
+            best.assign(s+b,s+e);
+            std::fill(d+b,d+e,I(0));
+            for(idx_t k=1; k<n; ++k) {
+                const T* row=s+k*inner;
+                for(idx_t i=b; i<e; ++i)
+                    if(better(row[i],best[i-b])) {
+                        best[i-b]=row[i];
+                        d[i]=static_cast<I>(k);
+                    }
+            }
+        }
+        first=o*inner+i1;
+    }
+}
+}
+
+template<typename T, unsigned int ndim, typename Allocator = std::allocator<T>, typename Policy = implicit_cow>
+class MultiArray;
+
+namespace exprutils {
+template<typename E> struct expr;
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
 class MultiArray
 {
 public:
@@ -43,43 +376,86 @@ public:
     typedef unsigned int smallidx_t;
     typedef typename sequtils::gens<ndim>::type idxseq;
     typedef std::array<smallidx_t,ndim> multiIdx_t;
+    typedef layout<ndim> layout_t;
 private:
-    std::shared_ptr<idx_t> strides;
+    Allocator alloc;
+    layout_t mlayout;
+    std::array<idx_t,ndim> strides;
     idx_t arr_size;
-    std::shared_ptr<T> data;
+    std::shared_ptr<T> mdata;
     multiIdx_t msize;
 
-    inline idx_t index(smallidx_t, smallidx_t i) const {
-        return i;
+    //storage, default-initialized like new T[]
+    //the buffer and its shared_ptr control block both come from the allocator
+
+    struct deleter {
+        Allocator alloc;
+        idx_t n;
+        void operator()(T* p) {
+            for(idx_t i=0; i<n; ++i)
+                std::allocator_traits<Allocator>::destroy(alloc,p+i);
+            std::allocator_traits<Allocator>::deallocate(alloc,p,n);
+        }
+    };
+
+    std::shared_ptr<T> allocate(idx_t n) const {
+        Allocator a(alloc);
+        T* p=std::allocator_traits<Allocator>::allocate(a,n);
+        idx_t i=0;
+        try {
+            for(; i<n; ++i)
+                ::new(static_cast<void*>(p+i)) T;
+        } catch(...) {
+            deleter{a,i}(p);
+            throw;
+        }
+        return std::shared_ptr<T>(p,deleter{a,n},a);
+    }
+
+    inline idx_t index(smallidx_t stridesidx, smallidx_t i) const {
+        return i*strides[stridesidx];
     }
 
     template<typename ... Types>
     inline idx_t index(smallidx_t stridesidx, smallidx_t i, Types... rest) const {
-        return i*strides.get()[stridesidx]+index(stridesidx+1,rest...);
+        return i*strides[stridesidx]+index(stridesidx+1,rest...);
     }
 
-    inline idx_t fill_strides(smallidx_t stridesidx,smallidx_t i) const {
-        return strides.get()[stridesidx]=i;
+    //dense strides in layout order, returns the element count
+    inline idx_t fill_strides(const multiIdx_t& size) {
+        idx_t n=1;
+        for(smallidx_t k=ndim; k-->0;) {
+            strides[mlayout.order()[k]]=n;
+            n*=size[mlayout.order()[k]];
+        }
+        return n;
     }
 
-    template<typename ... Types>
-    inline idx_t fill_strides(smallidx_t stridesidx, smallidx_t i, Types... rest) const {
-        return strides.get()[stridesidx]=fill_strides(stridesidx+1,rest...)*i;
+    //next multi-index in memory order
+    inline void increment(multiIdx_t& i) const {
+        for(smallidx_t k=ndim; k-->0;) {
+            smallidx_t j=mlayout.order()[k];
+            if(++i[j]<msize[j])
+                return;
+            i[j]=0;
+        }
     }
 
     inline const T& operator[](idx_t idx) const {
         check_size(idx);
-        return data.get()[idx];
+        return mdata.get()[idx];
     }
 
     inline T& operator[](idx_t idx) {
         check_size(idx);
-        if(!data.unique()) {
-            std::shared_ptr<T> other(new T[arr_size],std::default_delete<T[]>());
-            std::copy(data.get(),data.get()+arr_size,other.get());
-            data.swap(other);
-        }
-        return data.get()[idx];
+        prepare_write();
+        return mdata.get()[idx];
+    }
+
+    //implicit copy-on-write, only for policies that ask for it
+    inline void prepare_write() {
+        if(Policy::detach_on_write)
+            reserve_unique();
     }
 
     inline void check_valid() const {
@@ -92,6 +468,26 @@ private:
             throw std::out_of_range("MultiArray index out of range");
     }
 
+    void detach(bool keep) {
+        std::shared_ptr<T> other(allocate(arr_size));
+        if(keep)
+            std::copy(mdata.get(),mdata.get()+arr_size,other.get());
+        mdata.swap(other);
+    }
+
+    template<typename E>
+    void assign(const E& e);
+
+    inline multiIdx_t unravel(idx_t idx) const {
+        multiIdx_t i;
+        for(smallidx_t k=0; k<ndim; ++k) {
+            smallidx_t j=mlayout.order()[k];
+            i[j]=idx/strides[j];
+            idx=idx%strides[j];
+        }
+        return i;
+    }
+
     //array-based helpers
     template<typename A, smallidx_t ... I>
     inline const T& get_impl(const A& arr, sequtils::seq<I...>) const {
@@ -103,53 +499,78 @@ private:
         return set(arr[I]...);
     }
 
+    template<typename A, smallidx_t ... I>
+    inline const T& at_unchecked_impl(const A& arr, sequtils::seq<I...>) const {
+        return at_unchecked(arr[I]...);
+    }
+
+    template<typename A, smallidx_t ... I>
+    inline T& at_unchecked_impl(const A& arr, sequtils::seq<I...>) {
+        return at_unchecked(arr[I]...);
+    }
+
     //slice helpers
+    template<typename R, typename A, smallidx_t ... I>
+    inline R slice_impl(const A& arr, sequtils::seq<I...>) const {
+        return slice(std::get<I>(arr)...);
+    }
+
+    template<smallidx_t ... I>
+    MultiArray(const layout_t& l, const multiIdx_t& size, sequtils::seq<I...>) :
+        MultiArray(l,size[I]...)
+    {
 
-    template<smallidx_t slice_ndim, typename ... Types>
-    inline void slice_size(typename MultiArray<T,slice_ndim>::multiIdx_t &res, smallidx_t i, smallidx_t j, range& first, Types&...rest) {
-        if(first.size()==0)
-            first=range(0,size()[j]-1);
-        res[i]=first.size();
-        slice_size<slice_ndim>(res,i+1,j+1,rest...);
     }
 
-    template<smallidx_t slice_ndim, typename ... Types>
-    inline void slice_size(typename MultiArray<T,slice_ndim>::multiIdx_t &res, smallidx_t i, smallidx_t j, smallidx_t, Types&...rest) {
-        slice_size<slice_ndim>(res,i,j+1,rest...);
+    template<smallidx_t ... I>
+    MultiArray(const multiIdx_t& size, sequtils::seq<I...>) :
+        MultiArray(size[I]...)
+    {
+
     }
 
-    template<smallidx_t slice_ndim, typename ... Types>
-    inline void slice_size(typename MultiArray<T,slice_ndim>::multiIdx_t &, smallidx_t, smallidx_t) {}
+    template<typename, unsigned int, typename, typename> friend class MultiArray;
+    template<typename E>
+    MultiArray & compound(const exprutils::expr<E> &e) {
+        if(e.self().size()!=msize)
+            throw std::invalid_argument("MultiArray shape mismatch");
+        return *this=e;
+    }
 
-    template<int N2,typename ... Types>
-    inline void fill(MultiArray<T,N2> &res, typename MultiArray<T,N2>::multiIdx_t& idx, unsigned int idxn, multiIdx_t& idx2, unsigned int idxn2, range& first, Types&...rest) {
-        for(idx[idxn]=0; idx[idxn]<res.size()[idxn]; ++idx[idxn]) {
-            idx2[idxn2] = first[idx[idxn]];
-            fill<N2>(res,idx,idxn+1,idx2,idxn2+1,rest...);
-        }
+    //scatter helpers
+    template<typename Tuple, smallidx_t ... I>
+    void assign_slice_impl(const Tuple& t, sequtils::seq<I...>) {
+        scatter(std::get<sizeof...(I)>(t),std::get<I>(t)...);
     }
 
-    template<int N2,typename ... Types>
-    inline void fill(MultiArray<T,N2> &res, typename MultiArray<T,N2>::multiIdx_t& idx, unsigned int idxn, multiIdx_t& idx2, unsigned int idxn2, unsigned int first, Types&...rest) {
-        idx2[idxn2] = first;
-        fill<N2>(res,idx,idxn,idx2,idxn2+1,rest...);
+    template<smallidx_t N2>
+    static MultiArrayView<T,N2> source_view(const T& value, const std::array<smallidx_t,N2>& size) {
+        MultiArray<T,1> one(1);
+        one(0)=value;
+        return one.broadcast(size);
     }
 
-    template<int N2>
-    inline void fill(MultiArray<T,N2> &res, typename MultiArray<T,N2>::multiIdx_t& idx, unsigned int, multiIdx_t& idx2, unsigned int) {
-        res(idx)=(*this)(idx2);
+    template<smallidx_t N2>
+    static MultiArrayView<T,N2> source_view(const MultiArrayView<T,N2>& v, const std::array<smallidx_t,N2>&) {
+        return v;
     }
 
-    template<typename R, typename A, smallidx_t ... I>
-    inline R slice_impl(const A& arr, sequtils::seq<I...>) {
-        return slice(std::get<I>(arr)...);
+    template<smallidx_t N2, typename A, typename P>
+    static MultiArrayView<T,N2> source_view(const MultiArray<T,N2,A,P>& a, const std::array<smallidx_t,N2>&) {
+        return a.view();
     }
 
+    template<typename S, typename ... Types>
+    void scatter(const S& source, const Types&... args);
+
+    friend class MultiArrayView<T,ndim>;
+
 public:
     MultiArray() :
-        strides(nullptr),
+        mlayout(layout_t::row_major()),
+        strides(),
         arr_size(0),
-        data(nullptr),
+        mdata(nullptr),
         msize{{0}}
     {
 
@@ -157,39 +578,155 @@ public:
 
     template<typename ... Types>
     explicit MultiArray(smallidx_t nfirst, Types... counts) :
-        strides(new idx_t[ndim-1],std::default_delete<idx_t[]>()),
-        arr_size(nfirst*fill_strides(0,counts...)),
-        data(new T[arr_size],std::default_delete<T[]>()),
-        msize{{nfirst,counts...}}
+        MultiArray(layout_t::row_major(),nfirst,counts...)
+    {
+
+    }
+
+    //e.g. MultiArray<double,2>(layout<2>::column_major(),m,n) for Fortran order
+    template<typename ... Types>
+    MultiArray(const layout_t& l, smallidx_t nfirst, Types... counts) :
+        mlayout(l),
+        strides(),
+        arr_size(fill_strides(multiIdx_t{{nfirst,static_cast<smallidx_t>(counts)...}})),
+        mdata(allocate(arr_size)),
+        msize{{nfirst,static_cast<smallidx_t>(counts)...}}
     {
         static_assert(ndim==sizeof...(counts)+1,"Invalid number of arguments in MultiArray constructor");
     }
 
-    explicit MultiArray(smallidx_t nfirst) :
-        strides(nullptr),
-        arr_size(nfirst),
-        data(new T[arr_size],std::default_delete<T[]>()),
-        msize{{nfirst}}
+    //Adopt existing storage without copying. A plain pointer stays owned by
+    //the caller and has to outlive the array and its copies; pass a deleter or
+    //a shared_ptr to hand ownership over. The allocator is only used if the
+    //array later detaches into storage of its own.
+    MultiArray(const multiIdx_t& size, T* data) :
+        MultiArray(layout_t::row_major(),size,data)
+    {
+
+    }
+
+    MultiArray(const layout_t& l, const multiIdx_t& size, T* data) :
+        MultiArray(l,size,std::shared_ptr<T>(data,[](T*){}))
     {
-        static_assert(ndim==1,"Invalid number of arguments in MultiArray constructor");
+
     }
 
-    MultiArray(const MultiArray &) = default;
+    template<typename D>
+    MultiArray(const multiIdx_t& size, T* data, D deleter) :
+        MultiArray(layout_t::row_major(),size,std::shared_ptr<T>(data,std::move(deleter)))
+    {
+
+    }
 
-    MultiArray(MultiArray &&other) :
-        MultiArray(other)
+    MultiArray(const multiIdx_t& size, std::shared_ptr<T> data) :
+        MultiArray(layout_t::row_major(),size,std::move(data))
     {
-        other.clear();
+
+    }
+
+    MultiArray(const layout_t& l, const multiIdx_t& size, std::shared_ptr<T> data) :
+        mlayout(l),
+        strides(),
+        arr_size(fill_strides(size)),
+        mdata(std::move(data)),
+        msize(size)
+    {
+
+    }
+
+    //storage from a given allocator, e.g. one bound to another arena than the current one
+    MultiArray(const layout_t& l, const multiIdx_t& size, const Allocator& a) :
+        alloc(a),
+        mlayout(l),
+        strides(),
+        arr_size(fill_strides(size)),
+        mdata(allocate(arr_size)),
+        msize(size)
+    {
+
     }
 
-    MultiArray & operator=(const MultiArray &) = default;
+    MultiArray(const MultiArray &other) :
+        alloc(other.alloc),
+        mlayout(other.mlayout),
+        strides(other.strides),
+        arr_size(other.arr_size),
+        mdata(other.mdata),
+        msize(other.msize)
+    {
+        if(Policy::deep_copy)
+            reserve_unique();
+    }
 
-    MultiArray & operator=(MultiArray &&other) {
-        *this = other;
+    //moves steal the buffer, the moved-from array is left invalid
+    MultiArray(MultiArray &&other) noexcept :
+        alloc(other.alloc),
+        mlayout(other.mlayout),
+        strides(other.strides),
+        arr_size(other.arr_size),
+        mdata(std::move(other.mdata)),
+        msize(other.msize)
+    {
         other.clear();
+    }
+
+    MultiArray(const MultiArrayView<T,ndim> &view);
+
+    template<typename E>
+    MultiArray(const exprutils::expr<E> &e);
+
+    MultiArray & operator=(const MultiArray &other) {
+        if(this!=&other) {
+            alloc=other.alloc;
+            mlayout=other.mlayout;
+            strides=other.strides;
+            arr_size=other.arr_size;
+            mdata=other.mdata;
+            msize=other.msize;
+            if(Policy::deep_copy)
+                reserve_unique();
+        }
+        return *this;
+    }
+
+    MultiArray & operator=(MultiArray &&other) noexcept {
+        if(this!=&other) {
+            alloc=other.alloc;
+            mlayout=other.mlayout;
+            strides=other.strides;
+            arr_size=other.arr_size;
+            mdata=std::move(other.mdata);
+            msize=other.msize;
+            other.clear();
+        }
         return *this;
     }
 
+    template<typename E>
+    MultiArray & operator=(const exprutils::expr<E> &e);
+
+    //elementwise compound assignment, with arrays, expressions or scalars;
+    //the right side may broadcast to this array's shape, never grow it
+    template<typename X>
+    MultiArray & operator+=(const X& x) {
+        return compound(*this + x);
+    }
+
+    template<typename X>
+    MultiArray & operator-=(const X& x) {
+        return compound(*this - x);
+    }
+
+    template<typename X>
+    MultiArray & operator*=(const X& x) {
+        return compound(*this * x);
+    }
+
+    template<typename X>
+    MultiArray & operator/=(const X& x) {
+        return compound(*this / x);
+    }
+
     //arg-based
     template<typename ... Types>
     inline const T& get(Types... indexes) const {
@@ -233,103 +770,363 @@ public:
         return set(arr);
     }
 
+    //unchecked access: no validity, bounds or copy-on-write checks.
+    //Call reserve_unique() once before writing through these.
+
+    template<typename ... Types>
+    inline const T& at_unchecked(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in MultiArray::at_unchecked(...)");
+        return mdata.get()[index(0,indexes...)];
+    }
+
+    template<typename ... Types>
+    inline T& at_unchecked(Types... indexes) {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in MultiArray::at_unchecked(...)");
+        return mdata.get()[index(0,indexes...)];
+    }
+
+    inline const T& at_unchecked(const multiIdx_t &arr) const {
+        return at_unchecked_impl(arr,idxseq());
+    }
+
+    inline T& at_unchecked(const multiIdx_t &arr) {
+        return at_unchecked_impl(arr,idxseq());
+    }
+
+    inline const T* data() const {
+        return mdata.get();
+    }
+
+    //detaches from shared copies under implicit_cow, so the pointer can be written to
+    inline T* data() {
+        prepare_write();
+        return mdata.get();
+    }
+
+    //detach-once: takes a private copy of a shared buffer now, whatever the policy,
+    //so later writes never pay for it; like every ownership test here it is
+    //not synchronized with other threads holding copies
+    inline void reserve_unique() {
+        if(mdata && mdata.use_count()!=1)
+            detach(true);
+    }
+
     //utility
 
     inline multiIdx_t size() const {
         return msize;
     }
 
+    //total number of elements
+    inline idx_t flat_size() const {
+        return arr_size;
+    }
+
+    inline const layout_t& get_layout() const {
+        return mlayout;
+    }
+
+    //distance in elements between neighbours along dimension i
+    inline idx_t stride(smallidx_t i) const {
+        return strides[i];
+    }
+
+    inline Allocator get_allocator() const {
+        return alloc;
+    }
+
     inline bool valid() const {
-        return (strides||ndim==1) && data && arr_size;
+        return mdata && arr_size;
     }
 
-    inline void clear() {
-        strides.reset();
-        data.reset();
+    inline void clear() noexcept {
+        mdata.reset();
         arr_size=0;
         msize={{0}};
     }
 
+    //hands the buffer out, still shared with any copies, and leaves this array invalid
+    std::shared_ptr<T> release() noexcept {
+        std::shared_ptr<T> p=std::move(mdata);
+        clear();
+        return p;
+    }
+
+    //reshaping, O(1): the result shares this buffer like a copy does, so it is
+    //deep under explicit_clone. Elements keep their memory order, i.e. index
+    //order for row-major arrays and Fortran order for column-major ones; other
+    //layouts are first copied into row-major order.
+    template<std::size_t N2>
+    MultiArray<T,N2,Allocator,Policy> reshape(const std::array<smallidx_t,N2>& size) const {
+        check_valid();
+        idx_t n=1;
+        for(auto d : size)
+            n*=d;
+        if(n!=arr_size)
+            throw std::invalid_argument("MultiArray shape mismatch");
+        if(mlayout!=layout_t::row_major() && mlayout!=layout_t::column_major()) {
+            MultiArray dense(layout_t::row_major(),msize,alloc);
+            view().copy_to(dense.mdata.get());
+            return dense.reshape(size);
+        }
+        MultiArray<T,N2,Allocator,Policy> r(mlayout==layout_t::row_major() ? layout<N2>::row_major() : layout<N2>::column_major(),size,mdata);
+        r.alloc=alloc;
+        if(Policy::deep_copy)
+            r.reserve_unique();
+        return r;
+    }
+
+    template<smallidx_t N2, typename ... Types>
+    MultiArray<T,N2,Allocator,Policy> reshape(Types... counts) const {
+        static_assert(N2==sizeof...(counts),"Invalid number of arguments in MultiArray::reshape(...)");
+        return reshape(std::array<smallidx_t,N2>{{static_cast<smallidx_t>(counts)...}});
+    }
+
+    MultiArray<T,1,Allocator,Policy> flatten() const {
+        return reshape(std::array<smallidx_t,1>{{static_cast<smallidx_t>(arr_size)}});
+    }
+
+    //reductions along one axis, the result drops that dimension and keeps the
+    //layout of the others and this array's allocator; op(acc,x) is applied in
+    //index order along the axis
+    template<smallidx_t axis, typename Op>
+    MultiArray<T,ndim-1,Allocator,Policy> reduce(Op op) const {
+        static_assert(axis<ndim && ndim>1,"Invalid axis in MultiArray::reduce<...>()");
+        check_valid();
+        MultiArray<T,ndim-1,Allocator,Policy> r(reduceutils::drop_layout<axis>(mlayout),reduceutils::drop_size<axis>(msize),alloc);
+        reduceutils::fold(mdata.get(),r.mdata.get(),msize[axis],strides[axis],0,r.arr_size,op);
+        return r;
+    }
+
+    template<smallidx_t axis>
+    MultiArray<T,ndim-1,Allocator,Policy> sum() const {
+        return reduce<axis>(std::plus<T>());
+    }
+
+    template<smallidx_t axis>
+    MultiArray<T,ndim-1,Allocator,Policy> mean() const {
+        auto r=sum<axis>();
+        r/=T(msize[axis]);
+        return r;
+    }
+
+    template<smallidx_t axis>
+    MultiArray<T,ndim-1,Allocator,Policy> min() const {
+        return reduce<axis>([](const T& a, const T& b) { return b<a ? b : a; });
+    }
+
+    template<smallidx_t axis>
+    MultiArray<T,ndim-1,Allocator,Policy> max() const {
+        return reduce<axis>([](const T& a, const T& b) { return a<b ? b : a; });
+    }
+
+    //index of the first maximum along the axis, stored with this array's allocator rebound
+    template<smallidx_t axis>
+    MultiArray<smallidx_t,ndim-1,typename std::allocator_traits<Allocator>::template rebind_alloc<smallidx_t>,Policy> argmax() const {
+        static_assert(axis<ndim && ndim>1,"Invalid axis in MultiArray::argmax<...>()");
+        check_valid();
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<smallidx_t> index_alloc;
+        MultiArray<smallidx_t,ndim-1,index_alloc,Policy> r(reduceutils::drop_layout<axis>(mlayout),reduceutils::drop_size<axis>(msize),
+                                                           index_alloc(alloc));
+        auto better=[](const T& a, const T& b) { return b<a; };
+        reduceutils::arg_fold(mdata.get(),r.mdata.get(),msize[axis],strides[axis],0,r.arr_size,better);
+        return r;
+    }
+
+    //slicing
+
+    MultiArrayView<T,ndim> view() const;
+
+    //zero-copy axis reordering, copy() the result for a dense transposed array
+    template<smallidx_t ... axes>
+    MultiArrayView<T,ndim> permute() const {
+        return view().template permute<axes...>();
+    }
+
+    MultiArrayView<T,ndim> transpose() const {
+        return view().transpose();
+    }
+
+    template<std::size_t N2>
+    MultiArrayView<T,N2> broadcast(const std::array<smallidx_t,N2>& size) const {
+        return view().broadcast(size);
+    }
+
     template<typename ... Types>
-    MultiArray<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(Types... args);
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(Types... args) const;
 
     template<typename ... Types>
-    MultiArray<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(std::tuple<Types...> arg) {
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const std::tuple<Types...>& arg) const {
         return slice_impl<
-                MultiArray<T,ndim-sliceutils::count_idx<0,Types...>::value>
+                MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value>
                 >(arg,typename sequtils::gens<sizeof...(Types)>::type());
     }
 
+    //assign_slice(args...,source) writes source, an array, view or scalar shaped
+    //like slice(args...), into that part of this array; source may overlap it
+    template<typename ... Types>
+    void assign_slice(const Types&... args) {
+        static_assert(sizeof...(Types)==ndim+1,"Invalid number of arguments in MultiArray::assign_slice(...)");
+        assign_slice_impl(std::forward_as_tuple(args...),idxseq());
+    }
+
+    template<typename ... Types, typename S>
+    void assign_slice(const std::tuple<Types...>& args, const S& source) {
+        assign_slice_impl(std::tuple_cat(args,std::forward_as_tuple(source)),typename sequtils::gens<sizeof...(Types)>::type());
+    }
+
     //iterators
 
-    class iterator : public std::iterator<std::forward_iterator_tag, T>
+    //flat iterators, random access over the contiguous buffer in memory order
+    //
+    //Iterators cache the buffer pointer and size when created, so access costs
+    //no more than a bounds check; non-const ones detach from shared copies at
+    //that point, like data(). Unlike std containers the array shares its buffer
+    //with copies and views, so the rules are:
+    // - clear(), assigning to or moving from the array invalidates iterators
+    // - copying the array, or taking a view or reshape of it, invalidates
+    //   non-const iterators: the copy shares the cached buffer and writes
+    //   through them would reach it. Call begin() again, which detaches.
+    //const iterators stay valid across copies and views.
+
+    template<typename V, typename P>
+    class basic_iterator
     {
     protected:
         friend class MultiArray;
-        MultiArray* const arr;
+        template<typename, typename> friend class basic_iterator;
+        P* arr;
+        V* ptr;
         idx_t idx;
-        iterator(MultiArray* arr, idx_t idx) : arr(arr), idx(idx) {}
+        idx_t n;
+        basic_iterator(P* arr, idx_t idx) : arr(arr), ptr(arr->mdata.get()), idx(idx), n(arr->arr_size) {}
+        void fail() const {
+            arr->check_valid();
+            throw std::out_of_range("MultiArray index out of range");
+        }
     public:
-        iterator& operator++() {++idx; return *this;}
-        iterator operator++(int) {iterator tmp(*this); operator++(); return tmp;}
-        bool operator==(const iterator& rhs) const {return !(*this!=rhs);}
-        bool operator!=(const iterator& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
-        T& operator*() {arr->check_valid(); return (*arr)[idx];}
-        T* operator->() {return &(**this);}
-
-        MultiArray* parent() { return arr; }
+        typedef std::random_access_iterator_tag iterator_category;
+#if __cplusplus >= 202002L
+        typedef std::contiguous_iterator_tag iterator_concept;
+#endif
+        typedef typename std::remove_const<V>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_iterator() : arr(nullptr), ptr(nullptr), idx(0), n(0) {}
+        template<typename V2, typename P2,
+                 typename = typename std::enable_if<std::is_convertible<V2*,V*>::value>::type>
+        basic_iterator(const basic_iterator<V2,P2>& other) : arr(other.arr), ptr(other.ptr), idx(other.idx), n(other.n) {}
+
+        basic_iterator& operator++() {++idx; return *this;}
+        basic_iterator operator++(int) {basic_iterator tmp(*this); operator++(); return tmp;}
+        basic_iterator& operator--() {--idx; return *this;}
+        basic_iterator operator--(int) {basic_iterator tmp(*this); operator--(); return tmp;}
+        basic_iterator& operator+=(difference_type i) {idx+=i; return *this;}
+        basic_iterator& operator-=(difference_type i) {idx-=i; return *this;}
+        basic_iterator operator+(difference_type i) const {basic_iterator tmp(*this); return tmp+=i;}
+        basic_iterator operator-(difference_type i) const {basic_iterator tmp(*this); return tmp-=i;}
+        friend basic_iterator operator+(difference_type i, const basic_iterator& it) {return it+i;}
+        template<typename V2, typename P2>
+        difference_type operator-(const basic_iterator<V2,P2>& rhs) const {return difference_type(idx-rhs.idx);}
+
+        template<typename V2, typename P2>
+        bool operator==(const basic_iterator<V2,P2>& rhs) const {return !(*this!=rhs);}
+        template<typename V2, typename P2>
+        bool operator!=(const basic_iterator<V2,P2>& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator<(const basic_iterator<V2,P2>& rhs) const {return idx<rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator>(const basic_iterator<V2,P2>& rhs) const {return idx>rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator<=(const basic_iterator<V2,P2>& rhs) const {return idx<=rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator>=(const basic_iterator<V2,P2>& rhs) const {return idx>=rhs.idx;}
+
+        //only the cached size is checked here, validity is checked on failure
+        reference operator*() const {if(idx>=n) fail(); return ptr[idx];}
+        reference operator[](difference_type i) const {return *(*this+i);}
+        pointer operator->() const {return ptr+idx;}
+
+        P* parent() const { return arr; }
         const multiIdx_t index() const {
             arr->check_valid();
-            std::array<smallidx_t,ndim> i;
-            auto t=idx;
-            for(smallidx_t j=0; j<ndim-1; ++j) {
-                i[j]=t/arr->strides.get()[j];
-                t=t%arr->strides.get()[j];
-            }
-            i[ndim-1]=t;
-            return i;
+            return arr->unravel(idx);
         }
     };
 
-    class const_iterator : public std::iterator<std::forward_iterator_tag, T>
+    typedef basic_iterator<T,MultiArray> iterator;
+    typedef basic_iterator<const T,const MultiArray> const_iterator;
+
+    //n-dimensional iterators, carry the multi-index along so index() is O(1)
+
+    template<typename V, typename P>
+    class basic_nd_iterator
     {
     protected:
         friend class MultiArray;
-        const MultiArray* arr;
+        P* arr;
+        V* ptr;
         idx_t idx;
-        const_iterator(const MultiArray* arr, idx_t idx) : arr(arr), idx(idx) {}
-    public:
-        const_iterator& operator++() {++idx; return *this;}
-        const_iterator operator++(int) {const_iterator tmp(*this); operator++(); return tmp;}
-        bool operator==(const const_iterator& rhs) const {return !(*this!=rhs);}
-        bool operator!=(const const_iterator& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
-        const T& operator*() const {arr->check_valid(); return (*arr)[idx];}
-        const T* operator->() const {return &(**this);}
-
-        const MultiArray* parent() const { return arr; }
-        const multiIdx_t index() const {
+        idx_t n;
+        multiIdx_t cur;
+        multiIdx_t ext;
+        multiIdx_t ord;
+        basic_nd_iterator(P* arr, idx_t idx) : arr(arr), ptr(arr->mdata.get()), idx(idx), n(arr->arr_size), cur(idx<n?arr->unravel(idx):multiIdx_t()), ext(arr->msize), ord(arr->mlayout.order()) {}
+        void fail() const {
             arr->check_valid();
-            std::array<smallidx_t,ndim> i;
-            auto t=idx;
-            for(smallidx_t j=0; j<ndim-1; ++j) {
-                i[j]=t/arr->strides.get()[j];
-                t=t%arr->strides.get()[j];
+            throw std::out_of_range("MultiArray index out of range");
+        }
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::remove_const<V>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_nd_iterator() : arr(nullptr), ptr(nullptr), idx(0), n(0), cur{{0}}, ext{{0}}, ord{{0}} {}
+
+        basic_nd_iterator& operator++() {
+            ++idx;
+            for(smallidx_t k=ndim; k-->0;) {
+                smallidx_t j=ord[k];
+                if(++cur[j]<ext[j])
+                    break;
+                cur[j]=0;
             }
-            i[ndim-1]=t;
-            return i;
+            return *this;
+        }
+        basic_nd_iterator operator++(int) {basic_nd_iterator tmp(*this); operator++(); return tmp;}
+        bool operator==(const basic_nd_iterator& rhs) const {return !(*this!=rhs);}
+        bool operator!=(const basic_nd_iterator& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
+        reference operator*() const {if(idx>=n) fail(); return ptr[idx];}
+        pointer operator->() const {return ptr+idx;}
+
+        P* parent() const { return arr; }
+        const multiIdx_t& index() const {
+            return cur;
         }
     };
 
+    typedef basic_nd_iterator<T,MultiArray> nd_iterator;
+    typedef basic_nd_iterator<const T,const MultiArray> const_nd_iterator;
+
+    //non-const iterators detach from shared copies once, on creation
+
     iterator begin() {
+        prepare_write();
         return iterator(this,0);
     }
 
     iterator end() {
+        prepare_write();
         return iterator(this,arr_size);
     }
 
     template<typename ... Types>
     iterator make_iterator(Types... indices) {
+        prepare_write();
         return iterator(this, index(0,indices...));
     }
 
@@ -353,11 +1150,29 @@ public:
     const_iterator make_const_iterator(Types... indices) const {
         return const_iterator(this, index(0,indices...));
     }
-};
 
-namespace typeutils {
-template <template <typename> class pred, typename...> struct query_all;
-template <template <typename> class pred> struct query_all<pred>
+    nd_iterator nd_begin() {
+        prepare_write();
+        return nd_iterator(this,0);
+    }
+
+    nd_iterator nd_end() {
+        prepare_write();
+        return nd_iterator(this,arr_size);
+    }
+
+    const_nd_iterator const_nd_begin() const {
+        return const_nd_iterator(this,0);
+    }
+
+    const_nd_iterator const_nd_end() const {
+        return const_nd_iterator(this,arr_size);
+    }
+};
+
+namespace typeutils {
+template <template <typename> class pred, typename...> struct query_all;
+template <template <typename> class pred> struct query_all<pred>
     : std::integral_constant<bool, true> {};
 template <template <typename> class pred, typename T, typename... Args> struct query_all<pred, T, Args...>
     : std::integral_constant<bool, pred<T>::value && query_all<pred, Args...>::value> {};
@@ -379,18 +1194,785 @@ auto make_array(std::array<unsigned int,N> size) -> MultiArray<T,N> {
     return make_array_helper<T>(size,typename sequtils::gens<N>::type());
 }
 
+template<typename T, typename A, unsigned int ... I>
+auto make_array_helper(const layout<sizeof...(I)>& l, A arr, sequtils::seq<I...>) -> MultiArray<T,sizeof...(I)> {
+    return MultiArray<T,sizeof...(I)>(l,arr[I]...);
+}
+
+template<typename T, unsigned int N>
+auto make_array(const layout<N>& l, typename MultiArray<T,N>::multiIdx_t size) -> MultiArray<T,N> {
+    return make_array_helper<T>(l,size,typename sequtils::gens<N>::type());
+}
+
 template<typename T, unsigned int ndim>
+class MultiArrayView
+{
+public:
+    typedef unsigned long long int idx_t;
+    typedef unsigned int smallidx_t;
+    typedef typename sequtils::gens<ndim>::type idxseq;
+    typedef std::array<smallidx_t,ndim> multiIdx_t;
+    typedef std::array<idx_t,ndim> strides_t;
+private:
+    std::shared_ptr<const T> mdata;
+    idx_t offset;
+    strides_t strides;
+    idx_t arr_size;
+    multiIdx_t msize;
+
+    template<typename, unsigned int, typename, typename> friend class MultiArray;
+    template<typename, unsigned int> friend class MultiArrayView;
+    template<typename, unsigned int ...> friend class FixedMultiArray;
+
+    MultiArrayView(const std::shared_ptr<const T>& data, idx_t offset, const strides_t& strides, const multiIdx_t& msize) :
+        mdata(data),
+        offset(offset),
+        strides(strides),
+        arr_size(1),
+        msize(msize)
+    {
+        for(auto i : msize)
+            arr_size*=i;
+    }
+
+    inline idx_t index(smallidx_t) const {
+        return offset;
+    }
+
+    template<typename ... Types>
+    inline idx_t index(smallidx_t stridesidx, smallidx_t i, Types... rest) const {
+        check_size(i,msize[stridesidx]);
+        return i*strides[stridesidx]+index(stridesidx+1,rest...);
+    }
+
+    inline void check_valid() const {
+        if(!valid())
+            throw std::logic_error("Using invalid MultiArray");
+    }
+
+    static inline void check_size(idx_t idx, idx_t size) {
+        if(idx>=size)
+            throw std::out_of_range("MultiArray index out of range");
+    }
+
+    //array-based helpers
+    template<typename A, smallidx_t ... I>
+    inline const T& get_impl(const A& arr, sequtils::seq<I...>) const {
+        return get(arr[I]...);
+    }
+
+    //slice helpers
+    template<smallidx_t N2>
+    struct geometry {
+        idx_t offset;
+        std::array<idx_t,N2> strides;
+        std::array<smallidx_t,N2> size;
+        bool affine;
+    };
+
+    template<typename G, typename ... Types>
+    inline void slice_dims(G &res, smallidx_t i, smallidx_t j, const range& first, const Types&...rest) const {
+        if(first.empty()) {
+            res.size[i]=msize[j];
+            res.strides[i]=strides[j];
+        } else if(first.strided()) {
+            check_size(first.back(),msize[j]);
+            res.size[i]=first.size();
+            res.offset+=first.front()*strides[j];
+            res.strides[i]=first.step()*strides[j];
+        } else {
+            for(auto k : first)
+                check_size(k,msize[j]);
+            res.size[i]=first.size();
+            res.offset+=first[0]*strides[j];
+            res.strides[i]=first.size()>1 ? (first[1]-first[0])*strides[j] : strides[j];
+            for(idx_t k=1; k<first.size(); ++k)
+                if(first[k]<=first[k-1] || first[k]-first[k-1]!=first[1]-first[0])
+                    res.affine=false;
+        }
+        slice_dims(res,i+1,j+1,rest...);
+    }
+
+    template<typename G, typename ... Types>
+    inline void slice_dims(G &res, smallidx_t i, smallidx_t j, smallidx_t first, const Types&...rest) const {
+        check_size(first,msize[j]);
+        res.offset+=first*strides[j];
+        slice_dims(res,i,j+1,rest...);
+    }
+
+    template<typename G>
+    inline void slice_dims(G &, smallidx_t, smallidx_t) const {}
+
+    //element offsets per kept dimension, for selections strides can't express
+    template<typename L, typename ... Types>
+    inline void slice_lists(L &res, idx_t &base, smallidx_t i, smallidx_t j, const range& first, const Types&...rest) const {
+        if(first.empty()) {
+            res[i]=sliceutils::offsets(msize[j],strides[j]);
+        } else {
+            res[i].resize(first.size());
+            for(idx_t k=0; k<first.size(); ++k)
+                res[i][k]=first[k]*strides[j];
+        }
+        slice_lists(res,base,i+1,j+1,rest...);
+    }
+
+    template<typename L, typename ... Types>
+    inline void slice_lists(L &res, idx_t &base, smallidx_t i, smallidx_t j, smallidx_t first, const Types&...rest) const {
+        base+=first*strides[j];
+        slice_lists(res,base,i,j+1,rest...);
+    }
+
+    template<typename L>
+    inline void slice_lists(L &, idx_t &, smallidx_t, smallidx_t) const {}
+
+    template<typename R, typename A, smallidx_t ... I>
+    inline R slice_impl(const A& arr, sequtils::seq<I...>) const {
+        return slice(std::get<I>(arr)...);
+    }
+
+    template<smallidx_t ... I>
+    inline MultiArrayView reverse(sequtils::seq<I...>) const {
+        return permute<(ndim-1-I)...>();
+    }
+
+    void copy_to(T* dst) const;
+
+public:
+    MultiArrayView() :
+        mdata(nullptr),
+        offset(0),
+        strides{{0}},
+        arr_size(0),
+        msize{{0}}
+    {
+
+    }
+
+    //arg-based
+    template<typename ... Types>
+    inline const T& get(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in MultiArrayView::get(...)");
+        check_valid();
+        return mdata.get()[index(0,indexes...)];
+    }
+
+    template<typename ... Types>
+    inline const T& operator()(Types... indexes) const {
+        return get(indexes...);
+    }
+
+    //array-based
+
+    inline const T& get(const multiIdx_t& arr) const {
+        return get_impl(arr,idxseq());
+    }
+
+    inline const T& operator()(const multiIdx_t &arr) const {
+        return get(arr);
+    }
+
+    //utility
+
+    inline multiIdx_t size() const {
+        return msize;
+    }
+
+    inline bool valid() const {
+        return mdata && arr_size;
+    }
+
+    inline void clear() noexcept {
+        mdata.reset();
+        offset=0;
+        arr_size=0;
+        msize={{0}};
+    }
+
+    //materialize into a dense owning array
+    MultiArray<T,ndim> copy() const;
+
+    //axis reordering, zero-copy: dimension i of the result is dimension axes[i] of this view
+    template<smallidx_t ... axes>
+    MultiArrayView permute() const {
+        static_assert(sizeof...(axes)==ndim && sliceutils::is_permutation<ndim,axes...>::value,"Invalid axes in MultiArray::permute<...>()");
+        return MultiArrayView(mdata,offset,strides_t{{strides[axes]...}},multiIdx_t{{msize[axes]...}});
+    }
+
+    //reversed axes, the matrix transpose for ndim==2
+    MultiArrayView transpose() const {
+        return reverse(idxseq());
+    }
+
+    //zero-copy broadcast to a larger shape, numpy rules: missing leading
+    //dimensions and dimensions of size 1 repeat with stride 0
+    template<std::size_t N2>
+    MultiArrayView<T,N2> broadcast(const std::array<smallidx_t,N2>& size) const {
+        static_assert(N2>=ndim,"Broadcast to fewer dimensions in MultiArray::broadcast(...)");
+        check_valid();
+        std::array<idx_t,N2> s{{0}};
+        for(smallidx_t j=0; j<ndim; ++j) {
+            const std::size_t k=N2-ndim+j;
+            if(msize[j]==size[k])
+                s[k]=strides[j];
+            else if(msize[j]!=1)
+                throw std::invalid_argument("MultiArray shape mismatch");
+        }
+        return MultiArrayView<T,N2>(mdata,offset,s,size);
+    }
+
+    //slicing
+
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(Types... args) const;
+
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const std::tuple<Types...>& arg) const {
+        return slice_impl<
+                MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value>
+                >(arg,typename sequtils::gens<sizeof...(Types)>::type());
+    }
+
+    //iterators
+
+    class const_iterator
+    {
+    protected:
+        friend class MultiArrayView;
+        const MultiArrayView* view;
+        idx_t idx;
+        idx_t off;
+        multiIdx_t cur;
+        const_iterator(const MultiArrayView* view, idx_t idx) : view(view), idx(idx), off(view->offset), cur{{0}} {}
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator& operator++() {
+            ++idx;
+            for(smallidx_t j=ndim; j-->0;) {
+                off+=view->strides[j];
+                if(++cur[j]<view->msize[j])
+                    break;
+                off-=cur[j]*view->strides[j];
+                cur[j]=0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {const_iterator tmp(*this); operator++(); return tmp;}
+        bool operator==(const const_iterator& rhs) const {return !(*this!=rhs);}
+        bool operator!=(const const_iterator& rhs) const {return view!=rhs.view || idx!=rhs.idx;}
+        const T& operator*() const {
+            view->check_valid();
+            check_size(idx,view->arr_size);
+            return view->mdata.get()[off];
+        }
+        const T* operator->() const {return &(**this);}
+
+        const MultiArrayView* parent() const { return view; }
+        const multiIdx_t& index() const {
+            view->check_valid();
+            return cur;
+        }
+    };
+
+    const_iterator begin() const {
+        return const_begin();
+    }
+
+    const_iterator end() const {
+        return const_end();
+    }
+
+    const_iterator const_begin() const {
+        return const_iterator(this,0);
+    }
+
+    const_iterator const_end() const {
+        return const_iterator(this,arr_size);
+    }
+};
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+MultiArray<T,ndim,Allocator,Policy>::MultiArray(const MultiArrayView<T,ndim> &view) :
+    MultiArray(view.size(),idxseq())
+{
+    if(view.valid())
+        view.copy_to(mdata.get());
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+MultiArrayView<T,ndim> MultiArray<T,ndim,Allocator,Policy>::view() const {
+    typename MultiArrayView<T,ndim>::strides_t s;
+    for(smallidx_t j=0; j<ndim; ++j)
+        s[j]=valid()?stride(j):0;
+    return MultiArrayView<T,ndim>(mdata,0,s,msize);
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
 template<typename ... Types>
-MultiArray<T,ndim-sliceutils::count_idx<0,Types...>::value> MultiArray<T,ndim>::slice(Types... args) {
+MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> MultiArray<T,ndim,Allocator,Policy>::slice(Types... args) const {
+    return view().slice(args...);
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+template<typename S, typename ... Types>
+void MultiArray<T,ndim,Allocator,Policy>::scatter(const S& source, const Types&... args) {
+    constexpr smallidx_t N2=ndim-sliceutils::count_idx<0,Types...>::value;
+    static_assert(N2>0,"Slice of dimension<=0. Probably that's not what you want!");
+    check_valid();
+    typename MultiArrayView<T,ndim>::template geometry<N2> g;
+    g.offset=0;
+    g.affine=true;
+    std::array<std::vector<idx_t>,N2> dst;
+    idx_t base=0;
+    {
+        //the view must be gone before prepare_write, or it would always detach
+        const MultiArrayView<T,ndim> whole=view();
+        whole.slice_dims(g,0,0,args...);
+        if(!g.affine)
+            whole.slice_lists(dst,base,0,0,args...);
+    }
+    MultiArrayView<T,N2> src=source_view<N2>(source,g.size);
+    src.check_valid();
+    if(src.size()!=g.size)
+        throw std::invalid_argument("MultiArray shape mismatch");
+    //an overlapping source is copied out first, dropping its reference, so a
+    //source that is this array itself doesn't force a detach
+    if(src.mdata.get()==mdata.get())
+        src=src.copy().view();
+    prepare_write();
+    const T* s=src.mdata.get()+src.offset;
+    if(g.affine) {
+        sliceutils::strided_copy(s,src.strides,mdata.get()+g.offset,g.strides,g.size);
+    } else {
+        std::array<std::vector<idx_t>,N2> sl;
+        for(smallidx_t j=0; j<N2; ++j)
+            sl[j]=sliceutils::offsets(g.size[j],src.strides[j]);
+        sliceutils::indexed_copy(s,sl,mdata.get()+base,dst);
+    }
+}
+
+template<typename T, unsigned int ndim>
+MultiArray<T,ndim> MultiArrayView<T,ndim>::copy() const {
+    check_valid();
+    MultiArray<T,ndim> result = make_array<T>(msize);
+    copy_to(result.data());
+    return result;
+}
+
+//Row-major copy into dst. Contiguous runs are copied whole, otherwise the
+//last two dimensions go in square tiles, so a transposed source is read
+//and written a cache line at a time rather than an element per line.
+template<typename T, unsigned int ndim>
+void MultiArrayView<T,ndim>::copy_to(T* dst) const {
+    if(strides[ndim-1]==1 || msize[ndim-1]==1) {
+        strides_t dense;
+        idx_t n=1;
+        for(smallidx_t j=ndim; j-->0;) {
+            dense[j]=n;
+            n*=msize[j];
+        }
+        sliceutils::strided_copy(mdata.get()+offset,strides,dst,dense,msize);
+        return;
+    }
+    const smallidx_t tile=32;
+    const smallidx_t outer=ndim>1 ? ndim-2 : 0;
+    const smallidx_t rows=ndim>1 ? msize[outer] : 1, cols=msize[ndim-1];
+    const idx_t rs=ndim>1 ? strides[outer] : 0, cs=strides[ndim-1];
+    multiIdx_t cur{{0}};
+    idx_t off=offset;
+    for(idx_t done=0; done<arr_size; done+=idx_t(rows)*cols) {
+        const T* src=mdata.get()+off;
+        for(smallidx_t ib=0; ib<rows; ib+=tile)
+            for(smallidx_t jb=0; jb<cols; jb+=tile) {
+                const smallidx_t ie=rows-ib<tile ? rows : ib+tile, je=cols-jb<tile ? cols : jb+tile;
+                for(smallidx_t i=ib; i<ie; ++i)
+                    for(smallidx_t j=jb; j<je; ++j)
+                        dst[idx_t(i)*cols+j]=src[i*rs+j*cs];
+            }
+        dst+=idx_t(rows)*cols;
+        for(smallidx_t j=outer; j-->0;) {
+            off+=strides[j];
+            if(++cur[j]<msize[j])
+                break;
+            off-=cur[j]*strides[j];
+            cur[j]=0;
+        }
+    }
+}
+
+template<typename T, unsigned int ndim>
+template<typename ... Types>
+MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> MultiArrayView<T,ndim>::slice(Types... args) const {
     constexpr auto N=sliceutils::count_idx<0,Types...>::value;
     static_assert(N<ndim,"Slice of dimension<=0. Probably that's not what you want!");
-    std::array<unsigned int,ndim-N> size;
-    slice_size<ndim-N>(size,0,0,args...);
-    MultiArray<T,ndim-N> result = make_array<T>(size);
-    auto idx1=typename MultiArray<T,ndim-N>::multiIdx_t{{0}};
-    auto idx2=multiIdx_t{{0}};
-    fill<ndim-N>(result,idx1,0,idx2,0,args...);
-    return result;
+    static_assert(sizeof...(Types)==ndim,"Invalid number of arguments in MultiArray::slice(...)");
+    check_valid();
+    geometry<ndim-N> g;
+    g.offset=offset;
+    g.affine=true;
+    slice_dims(g,0,0,args...);
+    if(g.affine) //strided view into the same buffer
+        return MultiArrayView<T,ndim-N>(mdata,g.offset,g.strides,g.size);
+    //arbitrary index lists can't be expressed with strides, gather them
+    MultiArray<T,ndim-N> result = make_array<T>(g.size);
+    std::array<std::vector<idx_t>,ndim-N> src, dst;
+    idx_t base=offset;
+    slice_lists(src,base,0,0,args...);
+    for(smallidx_t j=0; j<ndim-N; ++j)
+        dst[j]=sliceutils::offsets(g.size[j],result.stride(j));
+    sliceutils::indexed_copy(mdata.get()+base,src,result.data(),dst);
+    return result.view();
+}
+
+namespace exprutils {
+//expression templates, evaluated in a single pass over the flat buffer
+//(or by multi-index when operands differ in layout or are broadcast)
+
+struct expr_tag {};
+
+template<typename E>
+struct expr : expr_tag {
+    inline const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+
+    template<typename X=E>
+    MultiArray<typename X::value_type,X::dims> eval() const {
+        return MultiArray<typename X::value_type,X::dims>(*this);
+    }
+};
+
+template<typename X>
+struct is_expr : std::integral_constant<bool,std::is_base_of<expr_tag,X>::value> {};
+
+template<typename X>
+struct is_multiarray : std::false_type {};
+
+template<typename T, unsigned int ndim, typename A, typename P>
+struct is_multiarray<MultiArray<T,ndim,A,P>> : std::true_type {};
+
+template<typename X>
+struct is_array_operand : std::integral_constant<bool,is_expr<X>::value || is_multiarray<X>::value> {};
+
+template<typename X>
+struct is_operand : std::integral_constant<bool,is_array_operand<X>::value || std::is_arithmetic<X>::value> {};
+
+template<typename T, unsigned int ndim>
+class terminal : public expr<terminal<T,ndim>>
+{
+    const T* ptr;
+    std::array<unsigned int,ndim> msize;
+    std::array<unsigned long long,ndim> strides;
+    layout<ndim> mlayout;
+public:
+    typedef T value_type;
+    static constexpr unsigned int dims=ndim;
+
+    //size 1 dimensions get stride 0 so they broadcast
+    template<typename A, typename P>
+    terminal(const MultiArray<T,ndim,A,P>& arr) : ptr(arr.data()), msize(arr.size()), strides(), mlayout(arr.get_layout()) {
+        if(!arr.valid())
+            throw std::logic_error("Using invalid MultiArray");
+        for(unsigned int j=0; j<ndim; ++j)
+            strides[j]=msize[j]==1 ? 0 : arr.stride(j);
+    }
+
+    inline std::array<unsigned int,ndim> size() const {
+        return msize;
+    }
+
+    inline const T& operator[](unsigned long long i) const {
+        return ptr[i];
+    }
+
+    //true if flat index i means the same element as in an array of this shape and strides
+    inline bool flat(const std::array<unsigned int,ndim>& size, const std::array<unsigned long long,ndim>& s) const {
+        if(size!=msize)
+            return false;
+        for(unsigned int j=0; j<ndim; ++j)
+            if(msize[j]!=1 && strides[j]!=s[j])
+                return false;
+        return true;
+    }
+
+    template<std::size_t N>
+    inline bool flat(const std::array<unsigned int,N>&, const std::array<unsigned long long,N>&) const {
+        return false;
+    }
+
+    //idx may have more leading dimensions than this operand
+    template<std::size_t N>
+    inline const T& at(const std::array<unsigned int,N>& idx) const {
+        unsigned long long i=0;
+        for(unsigned int j=0; j<ndim; ++j)
+            i+=idx[N-ndim+j]*strides[j];
+        return ptr[i];
+    }
+
+    inline bool find_layout(layout<ndim>& l) const {
+        l=mlayout;
+        return true;
+    }
+
+    template<typename Y>
+    inline bool find_layout(Y&) const {
+        return false;
+    }
+};
+
+template<typename S>
+class scalar : public expr<scalar<S>>
+{
+    S value;
+public:
+    typedef S value_type;
+    static constexpr unsigned int dims=0;
+
+    scalar(S value) : value(value) {}
+
+    inline std::array<unsigned int,0> size() const {
+        return std::array<unsigned int,0>();
+    }
+
+    inline S operator[](unsigned long long) const {
+        return value;
+    }
+
+    template<typename I, typename J>
+    inline bool flat(const I&, const J&) const {
+        return true;
+    }
+
+    template<typename I>
+    inline S at(const I&) const {
+        return value;
+    }
+
+    template<typename Y>
+    inline bool find_layout(Y&) const {
+        return false;
+    }
+};
+
+template<typename X, typename = void>
+struct leaf {
+    typedef X type;
+    static inline const X& make(const X& x) { return x; }
+};
+
+template<typename T, unsigned int ndim, typename A, typename P>
+struct leaf<MultiArray<T,ndim,A,P>> {
+    typedef terminal<T,ndim> type;
+    static inline type make(const MultiArray<T,ndim,A,P>& x) { return type(x); }
+};
+
+template<typename X>
+struct leaf<X, typename std::enable_if<std::is_arithmetic<X>::value>::type> {
+    typedef scalar<X> type;
+    static inline type make(X x) { return type(x); }
+};
+
+//broadcast shape, numpy rules: extents are matched from the last one and
+//an extent of 1, or a missing leading one, takes the other operand's
+template<std::size_t NA, std::size_t NB>
+inline std::array<unsigned int,(NA>NB ? NA : NB)> merge_size(const std::array<unsigned int,NA>& a, const std::array<unsigned int,NB>& b) {
+    const std::size_t N=NA>NB ? NA : NB;
+    std::array<unsigned int,N> r;
+    for(std::size_t k=0; k<N; ++k) {
+        unsigned int x=k<NA ? a[NA-1-k] : 1, y=k<NB ? b[NB-1-k] : 1;
+        if(x!=y && x!=1 && y!=1)
+            throw std::invalid_argument("MultiArray shape mismatch");
+        r[N-1-k]=x==1 ? y : x;
+    }
+    return r;
+}
+
+template<typename Op, typename L, typename R>
+class binary : public expr<binary<Op,L,R>>
+{
+    L lhs;
+    R rhs;
+public:
+    typedef decltype(Op()(std::declval<typename L::value_type>(),std::declval<typename R::value_type>())) value_type;
+    static constexpr unsigned int dims=L::dims>R::dims?L::dims:R::dims;
+private:
+    std::array<unsigned int,dims> msize;
+public:
+    binary(const L& lhs, const R& rhs) : lhs(lhs), rhs(rhs), msize(merge_size(lhs.size(),rhs.size())) {}
+
+    inline std::array<unsigned int,dims> size() const {
+        return msize;
+    }
+
+    inline value_type operator[](unsigned long long i) const {
+        return Op()(lhs[i],rhs[i]);
+    }
+
+    template<typename I, typename J>
+    inline bool flat(const I& size, const J& s) const {
+        return lhs.flat(size,s) && rhs.flat(size,s);
+    }
+
+    template<typename I>
+    inline value_type at(const I& idx) const {
+        return Op()(lhs.at(idx),rhs.at(idx));
+    }
+
+    template<typename Y>
+    inline bool find_layout(Y& l) const {
+        return lhs.find_layout(l) || rhs.find_layout(l);
+    }
+};
+
+template<typename Op, typename E>
+class unary : public expr<unary<Op,E>>
+{
+    E arg;
+public:
+    typedef decltype(Op()(std::declval<typename E::value_type>())) value_type;
+    static constexpr unsigned int dims=E::dims;
+
+    unary(const E& arg) : arg(arg) {}
+
+    inline std::array<unsigned int,dims> size() const {
+        return arg.size();
+    }
+
+    inline value_type operator[](unsigned long long i) const {
+        return Op()(arg[i]);
+    }
+
+    template<typename I, typename J>
+    inline bool flat(const I& size, const J& s) const {
+        return arg.flat(size,s);
+    }
+
+    template<typename I>
+    inline value_type at(const I& idx) const {
+        return Op()(arg.at(idx));
+    }
+
+    template<typename Y>
+    inline bool find_layout(Y& l) const {
+        return arg.find_layout(l);
+    }
+};
+
+//the result takes the layout of the leftmost array operand
+template<unsigned int ndim, typename E>
+inline layout<ndim> layout_of(const E& e) {
+    layout<ndim> l=layout<ndim>::row_major();
+    e.find_layout(l);
+    return l;
+}
+
+template<typename Op, typename A, typename B>
+struct enable_binary : std::enable_if<is_operand<A>::value && is_operand<B>::value &&
+                                      (is_array_operand<A>::value || is_array_operand<B>::value),
+                                      binary<Op,typename leaf<A>::type,typename leaf<B>::type>> {};
+
+template<typename Op, typename A>
+struct enable_unary : std::enable_if<is_array_operand<A>::value,unary<Op,typename leaf<A>::type>> {};
+
+struct add { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a+b) { return a+b; } };
+struct sub { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a-b) { return a-b; } };
+struct mul { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a*b) { return a*b; } };
+struct div { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a/b) { return a/b; } };
+struct neg { template<typename A> auto operator()(const A& a) const -> decltype(-a) { return -a; } };
+}
+
+template<typename A, typename B>
+inline auto operator+(const A& a, const B& b) -> typename exprutils::enable_binary<exprutils::add,A,B>::type {
+    return typename exprutils::enable_binary<exprutils::add,A,B>::type(exprutils::leaf<A>::make(a),exprutils::leaf<B>::make(b));
+}
+
+template<typename A, typename B>
+inline auto operator-(const A& a, const B& b) -> typename exprutils::enable_binary<exprutils::sub,A,B>::type {
+    return typename exprutils::enable_binary<exprutils::sub,A,B>::type(exprutils::leaf<A>::make(a),exprutils::leaf<B>::make(b));
+}
+
+template<typename A, typename B>
+inline auto operator*(const A& a, const B& b) -> typename exprutils::enable_binary<exprutils::mul,A,B>::type {
+    return typename exprutils::enable_binary<exprutils::mul,A,B>::type(exprutils::leaf<A>::make(a),exprutils::leaf<B>::make(b));
+}
+
+template<typename A, typename B>
+inline auto operator/(const A& a, const B& b) -> typename exprutils::enable_binary<exprutils::div,A,B>::type {
+    return typename exprutils::enable_binary<exprutils::div,A,B>::type(exprutils::leaf<A>::make(a),exprutils::leaf<B>::make(b));
+}
+
+template<typename A>
+inline auto operator-(const A& a) -> typename exprutils::enable_unary<exprutils::neg,A>::type {
+    return typename exprutils::enable_unary<exprutils::neg,A>::type(exprutils::leaf<A>::make(a));
+}
+
+//elementwise math functions, e.g. sqrt(a*a+b*b)
+#define MULTIARRAY_UNARY_FUNCTION(name) \
+namespace exprutils { \
+struct name##_op { template<typename A> auto operator()(const A& a) const -> decltype(std::name(a)) { return std::name(a); } }; \
+} \
+template<typename A> \
+inline auto name(const A& a) -> typename exprutils::enable_unary<exprutils::name##_op,A>::type { \
+    return typename exprutils::enable_unary<exprutils::name##_op,A>::type(exprutils::leaf<A>::make(a)); \
+}
+
+MULTIARRAY_UNARY_FUNCTION(abs)
+MULTIARRAY_UNARY_FUNCTION(sqrt)
+MULTIARRAY_UNARY_FUNCTION(exp)
+MULTIARRAY_UNARY_FUNCTION(log)
+MULTIARRAY_UNARY_FUNCTION(sin)
+MULTIARRAY_UNARY_FUNCTION(cos)
+MULTIARRAY_UNARY_FUNCTION(tan)
+MULTIARRAY_UNARY_FUNCTION(floor)
+MULTIARRAY_UNARY_FUNCTION(ceil)
+
+#undef MULTIARRAY_UNARY_FUNCTION
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+template<typename E>
+MultiArray<T,ndim,Allocator,Policy>::MultiArray(const exprutils::expr<E> &e) :
+    MultiArray(exprutils::layout_of<ndim>(e.self()),e.self().size(),idxseq())
+{
+    assign(e.self());
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+template<typename E>
+MultiArray<T,ndim,Allocator,Policy>& MultiArray<T,ndim,Allocator,Policy>::operator=(const exprutils::expr<E> &e) {
+    if(valid() && msize==e.self().size()) {
+        //every element gets overwritten, no need to copy shared data
+        if(Policy::detach_on_write && mdata.use_count()!=1)
+            detach(false);
+        assign(e.self());
+    } else {
+        //a new buffer from this array's allocator, not a default one
+        MultiArray tmp(exprutils::layout_of<ndim>(e.self()),e.self().size(),alloc);
+        tmp.assign(e.self());
+        *this=std::move(tmp);
+    }
+    return *this;
+}
+
+template<typename T, unsigned int ndim, typename Allocator, typename Policy>
+template<typename E>
+void MultiArray<T,ndim,Allocator,Policy>::assign(const E& e) {
+    static_assert(E::dims==ndim,"Expression of different dimension");
+    T* p=mdata.get();
+    if(e.flat(msize,strides)) {
+        for(idx_t i=0; i<arr_size; ++i)
+            p[i]=static_cast<T>(e[i]);
+        return;
+    }
+    //operands in another layout or broadcast, walk this array in memory order
+    multiIdx_t idx{{0}};
+    for(idx_t i=0; i<arr_size; ++i) {
+        p[i]=static_cast<T>(e.at(idx));
+        increment(idx);
+    }
 }
 
 #endif // MULTIARRAY_H
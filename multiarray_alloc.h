@@ -0,0 +1,311 @@
+#ifndef MULTIARRAY_ALLOC_H
+#define MULTIARRAY_ALLOC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace allocutils {
+//allocation helpers
+
+inline std::size_t bytes(std::size_t n, std::size_t size) {
+    if(n>std::numeric_limits<std::size_t>::max()/size)
+        throw std::bad_alloc();
+    return n*size;
+}
+
+inline std::size_t round_up(std::size_t n, std::size_t align) {
+    return (n+align-1)&~(align-1);
+}
+
+inline void* aligned_malloc(std::size_t size, std::size_t align) {
+#if defined(_WIN32)
+    void* p=_aligned_malloc(size,align);
+#else
+    void* p=nullptr;
+    if(posix_memalign(&p,align,size)!=0)
+        p=nullptr;
+#endif
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+inline void aligned_free(void* p) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+}
+
+//cache line (or SIMD register) aligned storage
+template<typename T, std::size_t Align=64>
+class aligned_allocator
+{
+    static_assert(Align>=alignof(T) && (Align&(Align-1))==0,"Alignment must be a power of two, at least alignof(T)");
+public:
+    typedef T value_type;
+    template<typename U> struct rebind { typedef aligned_allocator<U,Align> other; };
+
+    aligned_allocator() noexcept {}
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U,Align>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(allocutils::aligned_malloc(allocutils::bytes(n,sizeof(T)),Align));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        allocutils::aligned_free(p);
+    }
+};
+
+template<typename T, typename U, std::size_t Align>
+bool operator==(const aligned_allocator<T,Align>&, const aligned_allocator<U,Align>&) { return true; }
+
+template<typename T, typename U, std::size_t Align>
+bool operator!=(const aligned_allocator<T,Align>&, const aligned_allocator<U,Align>&) { return false; }
+
+//Blocks of at least one huge page are backed by huge pages: explicitly
+//reserved ones (MAP_HUGETLB) when available, otherwise 2MB-aligned memory
+//advised for transparent huge pages. Smaller blocks are cache line aligned.
+template<typename T>
+class hugepage_allocator
+{
+public:
+    static const std::size_t huge_page=std::size_t(2)<<20;
+
+    typedef T value_type;
+    template<typename U> struct rebind { typedef hugepage_allocator<U> other; };
+
+    hugepage_allocator() noexcept {}
+    template<typename U>
+    hugepage_allocator(const hugepage_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        std::size_t size=allocutils::bytes(n,sizeof(T));
+        if(size<huge_page)
+            return static_cast<T*>(allocutils::aligned_malloc(size,64));
+        size=allocutils::round_up(size,huge_page);
+#if defined(__linux__)
+        void* p=mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+        if(p!=MAP_FAILED)
+            return static_cast<T*>(p);
+        //no reserved huge pages, map extra to cut out an aligned block
+        char* q=static_cast<char*>(mmap(nullptr,size+huge_page,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0));
+        if(q==MAP_FAILED)
+            throw std::bad_alloc();
+        char* a=reinterpret_cast<char*>(allocutils::round_up(reinterpret_cast<std::uintptr_t>(q),huge_page));
+        if(a>q)
+            munmap(q,a-q);
+        if(q+huge_page>a)
+            munmap(a+size,q+huge_page-a);
+#ifdef MADV_HUGEPAGE
+        madvise(a,size,MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<T*>(a);
+#else
+        return static_cast<T*>(allocutils::aligned_malloc(size,huge_page));
+#endif
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        std::size_t size=n*sizeof(T);
+        if(size<huge_page) {
+            allocutils::aligned_free(p);
+            return;
+        }
+#if defined(__linux__)
+        munmap(p,allocutils::round_up(size,huge_page));
+#else
+        allocutils::aligned_free(p);
+#endif
+    }
+};
+
+template<typename T>
+const std::size_t hugepage_allocator<T>::huge_page;
+
+template<typename T, typename U>
+bool operator==(const hugepage_allocator<T>&, const hugepage_allocator<U>&) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const hugepage_allocator<T>&, const hugepage_allocator<U>&) { return false; }
+
+//Bump allocator for bursts of short-lived arrays. Memory is carved from large
+//chunks and handed back in one shot by release(), which keeps the chunks for
+//the next burst. Not thread safe: use one arena per thread.
+class arena
+{
+    struct chunk {
+        chunk* next;
+        std::size_t size;
+    };
+
+    std::size_t chunk_size;
+    chunk* used;
+    chunk* spare;
+    char* cur;
+    char* end;
+    char* last;
+
+    static char* begin(chunk* c) {
+        return reinterpret_cast<char*>(c)+allocutils::round_up(sizeof(chunk),alignof(std::max_align_t));
+    }
+
+    static char* finish(chunk* c) {
+        return reinterpret_cast<char*>(c)+c->size;
+    }
+
+    void grow(std::size_t size, std::size_t align) {
+        std::size_t need=allocutils::round_up(sizeof(chunk),alignof(std::max_align_t))+size+align;
+        chunk** s=&spare;
+        while(*s && (*s)->size<need)
+            s=&(*s)->next;
+        chunk* c=*s;
+        if(c) {
+            *s=c->next;
+        } else {
+            std::size_t n=need>chunk_size ? need : chunk_size;
+            c=static_cast<chunk*>(::operator new(n));
+            c->size=n;
+        }
+        c->next=used;
+        used=c;
+        cur=begin(c);
+        end=finish(c);
+    }
+
+    static void free_list(chunk* c) {
+        while(c) {
+            chunk* next=c->next;
+            ::operator delete(c);
+            c=next;
+        }
+    }
+
+public:
+    explicit arena(std::size_t chunk_size=std::size_t(1)<<20) :
+        chunk_size(chunk_size), used(nullptr), spare(nullptr), cur(nullptr), end(nullptr), last(nullptr)
+    {
+
+    }
+
+    arena(const arena&) = delete;
+    arena & operator=(const arena&) = delete;
+
+    ~arena() {
+        free_list(used);
+        free_list(spare);
+    }
+
+    void* allocate(std::size_t size, std::size_t align) {
+        char* p=reinterpret_cast<char*>(allocutils::round_up(reinterpret_cast<std::uintptr_t>(cur),align));
+        if(!cur || p>end || size>std::size_t(end-p)) {
+            grow(size,align);
+            p=reinterpret_cast<char*>(allocutils::round_up(reinterpret_cast<std::uintptr_t>(cur),align));
+        }
+        cur=p+size;
+        last=p;
+        return p;
+    }
+
+    //only the most recent block is given back, everything else waits for release()
+    void deallocate(void* p, std::size_t size) noexcept {
+        if(p==last && last+size==cur) {
+            cur=last;
+            last=nullptr;
+        }
+    }
+
+    //invalidates everything allocated so far
+    void release() noexcept {
+        while(used) {
+            chunk* next=used->next;
+            used->next=spare;
+            spare=used;
+            used=next;
+        }
+        cur=end=last=nullptr;
+    }
+
+    //arena bound to the calling thread by arena_scope, if any
+    static arena*& current() noexcept {
+        static thread_local arena* a=nullptr;
+        return a;
+    }
+};
+
+//binds an arena to the calling thread until the end of the scope
+class arena_scope
+{
+    arena* prev;
+public:
+    explicit arena_scope(arena& a) noexcept : prev(arena::current()) {
+        arena::current()=&a;
+    }
+
+    arena_scope(const arena_scope&) = delete;
+    arena_scope & operator=(const arena_scope&) = delete;
+
+    ~arena_scope() {
+        arena::current()=prev;
+    }
+};
+
+//Takes the arena bound to the thread when it is constructed, so arrays created
+//inside an arena_scope live in that arena, including their copy-on-write
+//copies. Without an arena it falls back to the global heap. Arrays must not
+//outlive the release() of their arena.
+template<typename T>
+class arena_allocator
+{
+    template<typename> friend class arena_allocator;
+    arena* a;
+public:
+    typedef T value_type;
+    template<typename U> struct rebind { typedef arena_allocator<U> other; };
+
+    arena_allocator() noexcept : a(arena::current()) {}
+    explicit arena_allocator(arena& a) noexcept : a(&a) {}
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept : a(other.a) {}
+
+    T* allocate(std::size_t n) {
+        std::size_t size=allocutils::bytes(n,sizeof(T));
+        if(a)
+            return static_cast<T*>(a->allocate(size,alignof(T)));
+        return static_cast<T*>(::operator new(size));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if(a)
+            a->deallocate(p,n*sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    arena* get_arena() const noexcept {
+        return a;
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.get_arena()==b.get_arena(); }
+
+template<typename T, typename U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.get_arena()!=b.get_arena(); }
+
+#endif // MULTIARRAY_ALLOC_H
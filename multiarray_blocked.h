@@ -0,0 +1,375 @@
+#ifndef MULTIARRAY_BLOCKED_H
+#define MULTIARRAY_BLOCKED_H
+
+#include "multiarray.h"
+
+namespace blockedutils {
+//chunk geometry helpers
+
+typedef unsigned long long int idx_t;
+
+constexpr idx_t power(idx_t b, unsigned int n) {
+    return n ? b*power(b,n-1) : 1;
+}
+}
+
+//Elements stored as Edge^ndim chunks, each row-major, the chunks themselves
+//row-major over the chunk grid, so neighbours along any dimension are usually
+//in the same chunk. Edge chunks are padded to full size. Copies are deep.
+//get/set/iterators/slice work on plain indices; for_each_chunk hands kernels
+//one chunk at a time.
+template<typename T, unsigned int ndim, unsigned int Edge=8>
+class BlockedMultiArray
+{
+public:
+    typedef unsigned long long int idx_t;
+    typedef unsigned int smallidx_t;
+    typedef std::array<smallidx_t,ndim> multiIdx_t;
+    typedef typename sequtils::gens<ndim>::type idxseq;
+    constexpr static idx_t chunk_size=blockedutils::power(Edge,ndim);
+private:
+    static_assert(ndim>0,"BlockedMultiArray needs at least one dimension");
+    static_assert(Edge>0,"BlockedMultiArray needs a non-empty chunk");
+
+    multiIdx_t msize;
+    multiIdx_t grid;
+    idx_t arr_size;
+    std::vector<T> mdata;
+
+    void init(const multiIdx_t& size) {
+        msize=size;
+        arr_size=1;
+        idx_t chunks=1;
+        for(smallidx_t j=0; j<ndim; ++j) {
+            grid[j]=(msize[j]+Edge-1)/Edge;
+            arr_size*=msize[j];
+            chunks*=grid[j];
+        }
+        mdata.assign(chunks*chunk_size,T());
+    }
+
+    inline idx_t index(const multiIdx_t& idx) const {
+        idx_t c=0, l=0;
+        for(smallidx_t j=0; j<ndim; ++j) {
+            c=c*grid[j]+idx[j]/Edge;
+            l=l*Edge+idx[j]%Edge;
+        }
+        return c*chunk_size+l;
+    }
+
+    inline void check_size(const multiIdx_t& idx) const {
+        for(smallidx_t j=0; j<ndim; ++j)
+            if(idx[j]>=msize[j])
+                throw std::out_of_range("MultiArray index out of range");
+    }
+
+    template<typename ... Types>
+    static multiIdx_t make_idx(Types... indexes) {
+        return multiIdx_t{{smallidx_t(indexes)...}};
+    }
+
+    //slice helpers, one index list per dimension and whether it is kept
+    void slice_lists(std::array<std::vector<smallidx_t>,ndim>&, std::array<bool,ndim>&, smallidx_t) const {}
+
+    template<typename ... Types>
+    void slice_lists(std::array<std::vector<smallidx_t>,ndim>& sel, std::array<bool,ndim>& kept, smallidx_t j, const range& first, const Types&... rest) const {
+        const idx_t n=first.empty() ? msize[j] : first.size();
+        sel[j].resize(n);
+        for(idx_t k=0; k<n; ++k) {
+            sel[j][k]=first.empty() ? smallidx_t(k) : first[k];
+            if(sel[j][k]>=msize[j])
+                throw std::out_of_range("MultiArray index out of range");
+        }
+        kept[j]=true;
+        slice_lists(sel,kept,j+1,rest...);
+    }
+
+    template<typename ... Types>
+    void slice_lists(std::array<std::vector<smallidx_t>,ndim>& sel, std::array<bool,ndim>& kept, smallidx_t j, smallidx_t first, const Types&... rest) const {
+        if(first>=msize[j])
+            throw std::out_of_range("MultiArray index out of range");
+        sel[j].assign(1,first);
+        kept[j]=false;
+        slice_lists(sel,kept,j+1,rest...);
+    }
+
+    template<typename Tuple, smallidx_t ... I>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,typename std::tuple_element<I,Tuple>::type...>::value>
+    slice_impl(const Tuple& t, sequtils::seq<I...>) const {
+        return slice(std::get<I>(t)...);
+    }
+
+public:
+    explicit BlockedMultiArray(const multiIdx_t& size) {
+        init(size);
+    }
+
+    template<typename ... Types>
+    explicit BlockedMultiArray(smallidx_t count, Types... counts) {
+        static_assert(sizeof...(counts)+1==ndim,"Invalid number of arguments in BlockedMultiArray::BlockedMultiArray(...)");
+        init(make_idx(count,counts...));
+    }
+
+    template<typename A, typename P>
+    explicit BlockedMultiArray(const MultiArray<T,ndim,A,P>& dense) {
+        init(dense.size());
+        for(auto i=dense.const_nd_begin(); i!=dense.const_nd_end(); ++i)
+            mdata[index(i.index())]=*i;
+    }
+
+    //row-major dense copy
+    MultiArray<T,ndim> to_dense() const {
+        MultiArray<T,ndim> result=make_array<T>(msize);
+        for(auto i=result.nd_begin(); i!=result.nd_end(); ++i)
+            *i=mdata[index(i.index())];
+        return result;
+    }
+
+    //access
+
+    inline const T& get(const multiIdx_t& idx) const {
+        check_size(idx);
+        return mdata[index(idx)];
+    }
+
+    inline T& set(const multiIdx_t& idx) {
+        check_size(idx);
+        return mdata[index(idx)];
+    }
+
+    template<typename ... Types>
+    inline const T& get(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in BlockedMultiArray::get(...)");
+        return get(make_idx(indexes...));
+    }
+
+    template<typename ... Types>
+    inline T& set(Types... indexes) {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in BlockedMultiArray::set(...)");
+        return set(make_idx(indexes...));
+    }
+
+    inline const T& operator()(const multiIdx_t& idx) const {
+        return get(idx);
+    }
+
+    inline T& operator()(const multiIdx_t& idx) {
+        return set(idx);
+    }
+
+    template<typename ... Types>
+    inline const T& operator()(Types... indexes) const {
+        return get(indexes...);
+    }
+
+    template<typename ... Types>
+    inline T& operator()(Types... indexes) {
+        return set(indexes...);
+    }
+
+    inline const T& at_unchecked(const multiIdx_t& idx) const {
+        return mdata[index(idx)];
+    }
+
+    inline T& at_unchecked(const multiIdx_t& idx) {
+        return mdata[index(idx)];
+    }
+
+    //utility
+
+    multiIdx_t size() const {
+        return msize;
+    }
+
+    idx_t flat_size() const {
+        return arr_size;
+    }
+
+    //chunks per dimension
+    multiIdx_t chunks() const {
+        return grid;
+    }
+
+    //element strides inside a chunk
+    constexpr static idx_t chunk_stride(smallidx_t j) {
+        return j+1>=ndim ? 1 : Edge*chunk_stride(j+1);
+    }
+
+    //Calls f(origin, extent, data) for every chunk in storage order: origin is
+    //the index of the chunk's first element, extent how many elements of it
+    //lie inside the array per dimension (Edge except on the far edges), data
+    //the chunk, element l at data[sum l[j]*chunk_stride(j)].
+    template<typename F>
+    void for_each_chunk(F f) {
+        for_each_chunk_impl(*this,f);
+    }
+
+    template<typename F>
+    void for_each_chunk(F f) const {
+        for_each_chunk_impl(*this,f);
+    }
+
+    //dense copy of the selection, same arguments as MultiArray::slice(...)
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const Types&... args) const {
+        constexpr smallidx_t N2=ndim-sliceutils::count_idx<0,Types...>::value;
+        static_assert(sizeof...(Types)==ndim,"Invalid number of arguments in BlockedMultiArray::slice(...)");
+        static_assert(N2>0,"Slice of dimension<=0. Probably that's not what you want!");
+        std::array<std::vector<smallidx_t>,ndim> sel;
+        std::array<bool,ndim> kept;
+        slice_lists(sel,kept,0,args...);
+        std::array<smallidx_t,N2> rsize;
+        for(smallidx_t j=0, i=0; j<ndim; ++j)
+            if(kept[j])
+                rsize[i++]=sel[j].size();
+        MultiArray<T,N2> result=make_array<T>(rsize);
+        multiIdx_t cur{{0}}, src;
+        T* dst=result.data();
+        for(idx_t n=0; n<result.flat_size(); ++n) {
+            for(smallidx_t j=0; j<ndim; ++j)
+                src[j]=sel[j][cur[j]];
+            dst[n]=mdata[index(src)];
+            for(smallidx_t j=ndim; j-->0;) {
+                if(++cur[j]<sel[j].size())
+                    break;
+                cur[j]=0;
+            }
+        }
+        return result.view();
+    }
+
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const std::tuple<Types...>& arg) const {
+        return slice_impl(arg,typename sequtils::gens<sizeof...(Types)>::type());
+    }
+
+    //iterators, chunk by chunk in storage order and row-major inside a
+    //chunk, padding skipped; index() is carried along
+
+    template<typename V, typename P>
+    class basic_iterator
+    {
+    protected:
+        friend class BlockedMultiArray;
+        P* arr;
+        idx_t idx;
+        idx_t n;
+        idx_t chunk;
+        multiIdx_t cur;
+        multiIdx_t origin;
+        multiIdx_t local;
+        multiIdx_t ext;
+        basic_iterator(P* arr, idx_t idx) : arr(arr), idx(idx), n(arr->arr_size), chunk(0), cur{{0}}, origin{{0}}, local{{0}}, ext{{0}} {
+            set_ext();
+        }
+        void set_ext() {
+            for(smallidx_t j=0; j<ndim; ++j)
+                ext[j]=std::min<smallidx_t>(Edge,arr->msize[j]-origin[j]);
+        }
+        idx_t offset() const {
+            idx_t l=0;
+            for(smallidx_t j=0; j<ndim; ++j)
+                l=l*Edge+local[j];
+            return chunk*chunk_size+l;
+        }
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::remove_const<V>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_iterator() : arr(nullptr), idx(0), n(0), chunk(0), cur{{0}}, origin{{0}}, local{{0}}, ext{{0}} {}
+
+        basic_iterator& operator++() {
+            if(++idx>=n)
+                return *this;
+            for(smallidx_t j=ndim; j-->0;) {
+                if(++local[j]<ext[j]) {
+                    cur[j]=origin[j]+local[j];
+                    return *this;
+                }
+                local[j]=0;
+                cur[j]=origin[j];
+            }
+            ++chunk;
+            for(smallidx_t j=ndim; j-->0;) {
+                origin[j]+=Edge;
+                if(origin[j]<arr->msize[j])
+                    break;
+                origin[j]=0;
+            }
+            cur=origin;
+            set_ext();
+            return *this;
+        }
+        basic_iterator operator++(int) {basic_iterator tmp(*this); operator++(); return tmp;}
+        bool operator==(const basic_iterator& rhs) const {return !(*this!=rhs);}
+        bool operator!=(const basic_iterator& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
+        reference operator*() const {
+            if(idx>=n)
+                throw std::out_of_range("MultiArray index out of range");
+            return arr->mdata[offset()];
+        }
+        pointer operator->() const {return &**this;}
+
+        P* parent() const { return arr; }
+        const multiIdx_t& index() const {
+            return cur;
+        }
+    };
+
+    typedef basic_iterator<T,BlockedMultiArray> iterator;
+    typedef basic_iterator<const T,const BlockedMultiArray> const_iterator;
+
+    iterator begin() {
+        return iterator(this,0);
+    }
+
+    iterator end() {
+        return iterator(this,arr_size);
+    }
+
+    const_iterator begin() const {
+        return const_begin();
+    }
+
+    const_iterator end() const {
+        return const_end();
+    }
+
+    const_iterator const_begin() const {
+        return const_iterator(this,0);
+    }
+
+    const_iterator const_end() const {
+        return const_iterator(this,arr_size);
+    }
+
+private:
+    template<typename A, typename F>
+    static void for_each_chunk_impl(A& arr, F& f) {
+        if(!arr.arr_size)
+            return;
+        multiIdx_t origin{{0}}, ext;
+        for(idx_t c=0;; ++c) {
+            for(smallidx_t j=0; j<ndim; ++j)
+                ext[j]=std::min<smallidx_t>(Edge,arr.msize[j]-origin[j]);
+            f(origin,ext,arr.mdata.data()+c*chunk_size);
+            smallidx_t j=ndim;
+            for(; j-->0;) {
+                origin[j]+=Edge;
+                if(origin[j]<arr.msize[j])
+                    break;
+                origin[j]=0;
+            }
+            if(j==smallidx_t(-1))
+                return;
+        }
+    }
+};
+
+template<typename T, unsigned int ndim, unsigned int Edge>
+constexpr typename BlockedMultiArray<T,ndim,Edge>::idx_t BlockedMultiArray<T,ndim,Edge>::chunk_size;
+
+#endif // MULTIARRAY_BLOCKED_H
@@ -0,0 +1,340 @@
+#ifndef MULTIARRAY_FIXED_H
+#define MULTIARRAY_FIXED_H
+
+#include "multiarray.h"
+
+namespace fixedutils {
+//compile-time shape helpers
+
+template<unsigned int ... Dims>
+struct product { constexpr static unsigned long long int value=1; };
+
+template<unsigned int D, unsigned int ... Dims>
+struct product<D,Dims...> { constexpr static unsigned long long int value=D*product<Dims...>::value; };
+
+//row-major stride of dimension I
+template<unsigned int I, unsigned int D, unsigned int ... Dims>
+struct stride : stride<I-1,Dims...> {};
+
+template<unsigned int D, unsigned int ... Dims>
+struct stride<0,D,Dims...> { constexpr static unsigned long long int value=product<Dims...>::value; };
+
+//extent of dimension I
+template<unsigned int I, unsigned int D, unsigned int ... Dims>
+struct extent : extent<I-1,Dims...> {};
+
+template<unsigned int D, unsigned int ... Dims>
+struct extent<0,D,Dims...> { constexpr static unsigned int value=D; };
+}
+
+//Shape fixed at compile time: elements are stored inline and index arithmetic
+//folds to constants, for small tiles like 3x3 or 4x4. Copies are deep.
+//view() and slice() share a heap copy of the tile, so like MultiArray's views
+//they are snapshots that stay valid after the array is gone. That costs one
+//allocation and a copy of the whole tile per call: keep them out of inner
+//loops and use operator() or the iterators there.
+template<typename T, unsigned int ... Dims>
+class FixedMultiArray
+{
+public:
+    typedef unsigned long long int idx_t;
+    typedef unsigned int smallidx_t;
+    constexpr static unsigned int ndim=sizeof...(Dims);
+    typedef typename sequtils::gens<ndim>::type idxseq;
+    typedef std::array<smallidx_t,ndim> multiIdx_t;
+private:
+    static_assert(ndim>0,"FixedMultiArray needs at least one dimension");
+    constexpr static idx_t arr_size=fixedutils::product<Dims...>::value;
+
+    std::array<T,arr_size> mdata;
+
+    template<smallidx_t I>
+    constexpr static idx_t index() {
+        return 0;
+    }
+
+    template<smallidx_t I, typename ... Types>
+    constexpr static idx_t index(smallidx_t i, Types... rest) {
+        return i*fixedutils::stride<I,Dims...>::value+index<I+1>(rest...);
+    }
+
+    template<smallidx_t I>
+    inline static void check_size() {}
+
+    template<smallidx_t I, typename ... Types>
+    inline static void check_size(smallidx_t i, Types... rest) {
+        if(i>=fixedutils::extent<I,Dims...>::value)
+            throw std::out_of_range("MultiArray index out of range");
+        check_size<I+1>(rest...);
+    }
+
+    template<smallidx_t ... I>
+    constexpr static std::array<idx_t,ndim> strides_impl(sequtils::seq<I...>) {
+        return std::array<idx_t,ndim>{{fixedutils::stride<I,Dims...>::value...}};
+    }
+
+    //row-major multi-index of flat index i
+    static multiIdx_t unravel(idx_t i) {
+        multiIdx_t idx;
+        const multiIdx_t s=size();
+        for(smallidx_t j=ndim; j-->0;) {
+            idx[j]=i%s[j];
+            i/=s[j];
+        }
+        return idx;
+    }
+
+    template<typename A, smallidx_t ... I>
+    inline const T& get_impl(const A& arr, sequtils::seq<I...>) const {
+        return get(arr[I]...);
+    }
+
+    template<typename A, smallidx_t ... I>
+    inline T& set_impl(const A& arr, sequtils::seq<I...>) {
+        return set(arr[I]...);
+    }
+
+    template<typename A, smallidx_t ... I>
+    inline const T& at_unchecked_impl(const A& arr, sequtils::seq<I...>) const {
+        return at_unchecked(arr[I]...);
+    }
+
+    template<typename A, smallidx_t ... I>
+    inline T& at_unchecked_impl(const A& arr, sequtils::seq<I...>) {
+        return at_unchecked(arr[I]...);
+    }
+
+public:
+    //arg-based
+    template<typename ... Types>
+    inline const T& get(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in FixedMultiArray::get(...)");
+        check_size<0>(indexes...);
+        return mdata[index<0>(indexes...)];
+    }
+
+    template<typename ... Types>
+    inline T& set(Types... indexes) {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in FixedMultiArray::set(...)");
+        check_size<0>(indexes...);
+        return mdata[index<0>(indexes...)];
+    }
+
+    template<typename ... Types>
+    inline const T& operator()(Types... indexes) const {
+        return get(indexes...);
+    }
+
+    template<typename ... Types>
+    inline T& operator()(Types... indexes) {
+        return set(indexes...);
+    }
+
+    //array-based
+
+    inline const T& get(const multiIdx_t& arr) const {
+        return get_impl(arr,idxseq());
+    }
+
+    inline T& set(const multiIdx_t& arr) {
+        return set_impl(arr,idxseq());
+    }
+
+    inline const T& operator()(const multiIdx_t &arr) const {
+        return get(arr);
+    }
+
+    inline T& operator()(const multiIdx_t &arr) {
+        return set(arr);
+    }
+
+    //unchecked access
+
+    template<typename ... Types>
+    inline const T& at_unchecked(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in FixedMultiArray::at_unchecked(...)");
+        return mdata[index<0>(indexes...)];
+    }
+
+    template<typename ... Types>
+    inline T& at_unchecked(Types... indexes) {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in FixedMultiArray::at_unchecked(...)");
+        return mdata[index<0>(indexes...)];
+    }
+
+    inline const T& at_unchecked(const multiIdx_t &arr) const {
+        return at_unchecked_impl(arr,idxseq());
+    }
+
+    inline T& at_unchecked(const multiIdx_t &arr) {
+        return at_unchecked_impl(arr,idxseq());
+    }
+
+    inline const T* data() const {
+        return mdata.data();
+    }
+
+    inline T* data() {
+        return mdata.data();
+    }
+
+    //utility
+
+    constexpr static multiIdx_t size() {
+        return multiIdx_t{{Dims...}};
+    }
+
+    constexpr static idx_t flat_size() {
+        return arr_size;
+    }
+
+    template<smallidx_t I>
+    constexpr static idx_t stride() {
+        return fixedutils::stride<I,Dims...>::value;
+    }
+
+    constexpr static std::array<idx_t,ndim> strides() {
+        return strides_impl(idxseq());
+    }
+
+    void fill(const T& value) {
+        mdata.fill(value);
+    }
+
+    //views and slices, same rules as MultiArray::slice(...)
+
+    //allocates, see the class comment
+    MultiArrayView<T,ndim> view() const {
+        auto copy=std::make_shared<const std::array<T,arr_size> >(mdata);
+        return MultiArrayView<T,ndim>(std::shared_ptr<const T>(copy,copy->data()),0,strides(),size());
+    }
+
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const Types&... args) const {
+        return view().slice(args...);
+    }
+
+    template<typename ... Types>
+    MultiArrayView<T,ndim-sliceutils::count_idx<0,Types...>::value> slice(const std::tuple<Types...>& arg) const {
+        return view().slice(arg);
+    }
+
+    //iterators, random access in row-major order; index() unravels with
+    //compile-time extents, so there is no separate n-dimensional iterator
+
+    template<typename V, typename P>
+    class basic_iterator
+    {
+    protected:
+        friend class FixedMultiArray;
+        template<typename, typename> friend class basic_iterator;
+        P* arr;
+        idx_t idx;
+        basic_iterator(P* arr, idx_t idx) : arr(arr), idx(idx) {}
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+#if __cplusplus >= 202002L
+        typedef std::contiguous_iterator_tag iterator_concept;
+#endif
+        typedef typename std::remove_const<V>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_iterator() : arr(nullptr), idx(0) {}
+        template<typename V2, typename P2,
+                 typename = typename std::enable_if<std::is_convertible<V2*,V*>::value>::type>
+        basic_iterator(const basic_iterator<V2,P2>& other) : arr(other.arr), idx(other.idx) {}
+
+        basic_iterator& operator++() {++idx; return *this;}
+        basic_iterator operator++(int) {basic_iterator tmp(*this); operator++(); return tmp;}
+        basic_iterator& operator--() {--idx; return *this;}
+        basic_iterator operator--(int) {basic_iterator tmp(*this); operator--(); return tmp;}
+        basic_iterator& operator+=(difference_type i) {idx+=i; return *this;}
+        basic_iterator& operator-=(difference_type i) {idx-=i; return *this;}
+        basic_iterator operator+(difference_type i) const {basic_iterator tmp(*this); return tmp+=i;}
+        basic_iterator operator-(difference_type i) const {basic_iterator tmp(*this); return tmp-=i;}
+        friend basic_iterator operator+(difference_type i, const basic_iterator& it) {return it+i;}
+        template<typename V2, typename P2>
+        difference_type operator-(const basic_iterator<V2,P2>& rhs) const {return difference_type(idx-rhs.idx);}
+
+        template<typename V2, typename P2>
+        bool operator==(const basic_iterator<V2,P2>& rhs) const {return !(*this!=rhs);}
+        template<typename V2, typename P2>
+        bool operator!=(const basic_iterator<V2,P2>& rhs) const {return arr!=rhs.arr || idx!=rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator<(const basic_iterator<V2,P2>& rhs) const {return idx<rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator>(const basic_iterator<V2,P2>& rhs) const {return idx>rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator<=(const basic_iterator<V2,P2>& rhs) const {return idx<=rhs.idx;}
+        template<typename V2, typename P2>
+        bool operator>=(const basic_iterator<V2,P2>& rhs) const {return idx>=rhs.idx;}
+
+        reference operator*() const {
+            if(idx>=arr_size)
+                throw std::out_of_range("MultiArray index out of range");
+            return arr->mdata[idx];
+        }
+        reference operator[](difference_type i) const {return *(*this+i);}
+        pointer operator->() const {return arr->mdata.data()+idx;}
+
+        P* parent() const { return arr; }
+        const multiIdx_t index() const {
+            return unravel(idx);
+        }
+    };
+
+    typedef basic_iterator<T,FixedMultiArray> iterator;
+    typedef basic_iterator<const T,const FixedMultiArray> const_iterator;
+    typedef iterator nd_iterator;
+    typedef const_iterator const_nd_iterator;
+
+    iterator begin() {
+        return iterator(this,0);
+    }
+
+    iterator end() {
+        return iterator(this,arr_size);
+    }
+
+    const_iterator begin() const {
+        return const_begin();
+    }
+
+    const_iterator end() const {
+        return const_end();
+    }
+
+    const_iterator const_begin() const {
+        return const_iterator(this,0);
+    }
+
+    const_iterator const_end() const {
+        return const_iterator(this,arr_size);
+    }
+
+    nd_iterator nd_begin() {
+        return begin();
+    }
+
+    nd_iterator nd_end() {
+        return end();
+    }
+
+    const_nd_iterator const_nd_begin() const {
+        return const_begin();
+    }
+
+    const_nd_iterator const_nd_end() const {
+        return const_end();
+    }
+};
+
+template<typename T, unsigned int ... Dims>
+constexpr unsigned int FixedMultiArray<T,Dims...>::ndim;
+
+template<typename T, unsigned int ... Dims>
+constexpr typename FixedMultiArray<T,Dims...>::idx_t FixedMultiArray<T,Dims...>::arr_size;
+
+#endif // MULTIARRAY_FIXED_H
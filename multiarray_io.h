@@ -0,0 +1,495 @@
+#ifndef MULTIARRAY_IO_H
+#define MULTIARRAY_IO_H
+
+#include "multiarray.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MULTIARRAY_IO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace io {
+//read_only: the file is never modified, writes stay private to the process
+//read_write: writes go through to the file
+enum class map_mode { read_only, read_write };
+
+//native: the MultiArray header below
+//npy: numpy's .npy format, C or Fortran order; load and map recognise both
+enum class format { native, npy };
+}
+
+namespace ioutils {
+//File layout, native byte order:
+//  "MARRAY", version, element kind ('i','u','f','b' or 'v' for other types),
+//  element size, ndim, data offset, then ndim 64-bit extents; the payload
+//  starts at the data offset, a multiple of 64, and is stored row-major;
+//  arrays in other layouts are reordered on save.
+
+const std::uint8_t version=1;
+const std::uint64_t payload_align=64;
+
+struct file_header {
+    char magic[6];
+    std::uint8_t version;
+    char kind;
+    std::uint32_t elem_size;
+    std::uint32_t ndim;
+    std::uint64_t data_offset;
+};
+
+template<typename T>
+struct kind : std::integral_constant<char,std::is_same<T,bool>::value ? 'b' :
+                                          std::is_floating_point<T>::value ? 'f' :
+                                          std::is_integral<T>::value ? (std::is_signed<T>::value ? 'i' : 'u') : 'v'> {};
+
+inline std::uint64_t data_offset(unsigned int ndim) {
+    return (sizeof(file_header)+ndim*sizeof(std::uint64_t)+payload_align-1)/payload_align*payload_align;
+}
+
+template<typename T, unsigned int ndim>
+void write_header(char* p, const std::array<unsigned int,ndim>& size) {
+    std::memset(p,0,data_offset(ndim));
+    file_header h;
+    std::memcpy(h.magic,"MARRAY",6);
+    h.version=version;
+    h.kind=kind<T>::value;
+    h.elem_size=sizeof(T);
+    h.ndim=ndim;
+    h.data_offset=data_offset(ndim);
+    std::memcpy(p,&h,sizeof(h));
+    for(unsigned int j=0; j<ndim; ++j) {
+        std::uint64_t d=size[j];
+        std::memcpy(p+sizeof(h)+j*sizeof(d),&d,sizeof(d));
+    }
+}
+
+//extent d from a file as an index, multiplied into count; extents that don't
+//fit smallidx_t or overflow the element count are rejected
+inline unsigned int checked_extent(std::uint64_t d, std::uint64_t& count) {
+    if(d>std::numeric_limits<unsigned int>::max() || (d && count>std::numeric_limits<std::uint64_t>::max()/d))
+        throw std::runtime_error("MultiArray file type mismatch");
+    count*=d;
+    return static_cast<unsigned int>(d);
+}
+
+//checks a header against T and ndim, returns the extents
+template<typename T, unsigned int ndim>
+std::array<unsigned int,ndim> read_header(const char* p, std::uint64_t n, std::uint64_t& offset) {
+    file_header h;
+    if(n<sizeof(h))
+        throw std::runtime_error("Truncated MultiArray file");
+    std::memcpy(&h,p,sizeof(h));
+    if(std::memcmp(h.magic,"MARRAY",6)!=0 || h.version!=version)
+        throw std::runtime_error("Not a MultiArray file");
+    if(h.kind!=kind<T>::value || h.elem_size!=sizeof(T) || h.ndim!=ndim)
+        throw std::runtime_error("MultiArray file type mismatch");
+    if(h.data_offset<data_offset(ndim) || h.data_offset>n)
+        throw std::runtime_error("Truncated MultiArray file");
+    std::array<unsigned int,ndim> size;
+    std::uint64_t count=1;
+    for(unsigned int j=0; j<ndim; ++j) {
+        std::uint64_t d;
+        std::memcpy(&d,p+sizeof(h)+j*sizeof(d),sizeof(d));
+        size[j]=checked_extent(d,count);
+    }
+    if((n-h.data_offset)/sizeof(T)<count)
+        throw std::runtime_error("Truncated MultiArray file");
+    offset=h.data_offset;
+    return size;
+}
+
+//NPY: "\x93NUMPY", major, minor, little-endian header length (16 bits in
+//version 1, 32 bits after), then a Python dict literal padded to 64 bytes
+
+inline std::uint64_t little_endian(const char* p, unsigned int bytes) {
+    std::uint64_t v=0;
+    for(unsigned int i=bytes; i-->0;)
+        v=(v<<8)|static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+template<typename T>
+std::string npy_descr() {
+    const std::uint16_t one=1;
+    char little;
+    std::memcpy(&little,&one,1);
+    if(kind<T>::value=='v')
+        throw std::runtime_error("Type can't be stored in NPY files");
+    return std::string(1,sizeof(T)==1 ? '|' : little ? '<' : '>')+kind<T>::value+std::to_string(sizeof(T));
+}
+
+template<typename T, unsigned int ndim>
+std::string npy_header(const std::array<unsigned int,ndim>& size, bool fortran) {
+    std::string dict="{'descr': '"+npy_descr<T>()+"', 'fortran_order': "+(fortran ? "True" : "False")+", 'shape': (";
+    for(unsigned int j=0; j<ndim; ++j)
+        dict+=std::to_string(size[j])+(ndim==1 ? "," : j+1<ndim ? ", " : "");
+    dict+="), }";
+    std::size_t total=(10+dict.size()+1+payload_align-1)/payload_align*payload_align;
+    dict.append(total-10-dict.size()-1,' ');
+    dict+='\n';
+    std::string h("\x93NUMPY\x01\x00",8);
+    h+=static_cast<char>((total-10)&0xff);
+    h+=static_cast<char>((total-10)>>8);
+    return h+dict;
+}
+
+//text following 'key': in the header dict
+inline std::string npy_field(const std::string& dict, const char* key) {
+    std::size_t i=dict.find(std::string("'")+key+"'");
+    if(i==std::string::npos || (i=dict.find(':',i))==std::string::npos)
+        throw std::runtime_error("Unsupported NPY file");
+    return dict.substr(i+1);
+}
+
+//the value a field starts with, up to the next ',' or '}', spaces trimmed
+inline std::string npy_token(const std::string& field) {
+    const char* space=" \t\r\n";
+    std::size_t b=field.find_first_not_of(space);
+    if(b==std::string::npos)
+        return std::string();
+    std::string t=field.substr(b,field.find_first_of(",}",b)-b);
+    t.erase(t.find_last_not_of(space)+1);
+    return t;
+}
+
+//bytes needed to decode the header, given its first 12
+inline std::uint64_t header_length(const char* p, std::uint64_t n, unsigned int ndim) {
+    if(n>=6 && std::memcmp(p,"MARRAY",6)==0)
+        return data_offset(ndim);
+    if(n>=10 && std::memcmp(p,"\x93NUMPY",6)==0)
+        return p[6]==1 ? 10+little_endian(p+8,2) : n>=12 ? 12+little_endian(p+8,4) : n+1;
+    throw std::runtime_error("Not a MultiArray file");
+}
+
+template<typename T, unsigned int ndim>
+std::array<unsigned int,ndim> read_npy_header(const char* p, std::uint64_t n, std::uint64_t file_size, std::uint64_t& offset, bool& fortran) {
+    std::uint64_t length=header_length(p,n,ndim);
+    if(n<length)
+        throw std::runtime_error("Truncated MultiArray file");
+    std::string dict(p+(p[6]==1 ? 10 : 12),p+length);
+    std::string descr=npy_field(dict,"descr");
+    std::size_t q=descr.find('\'');
+    if(q==std::string::npos)
+        throw std::runtime_error("Unsupported NPY file");
+    descr=descr.substr(q+1,descr.find('\'',q+1)-q-1);
+    std::string expected=npy_descr<T>();
+    if(!descr.empty() && (descr[0]=='=' || (descr[0]=='|' && sizeof(T)==1)))
+        descr[0]=expected[0];
+    if(descr!=expected)
+        throw std::runtime_error("MultiArray file type mismatch");
+    std::string order=npy_token(npy_field(dict,"fortran_order"));
+    if(order=="False")
+        fortran=false;
+    else if(order=="True")
+        fortran=true;
+    else
+        throw std::runtime_error("Unsupported NPY file");
+    std::string shape=npy_field(dict,"shape");
+    shape=shape.substr(0,shape.find(')'));
+    std::array<unsigned int,ndim> size;
+    std::uint64_t count=1;
+    unsigned int j=0;
+    for(std::size_t i=0; i<shape.size(); ++i) {
+        if(shape[i]<'0' || shape[i]>'9')
+            continue;
+        if(j==ndim)
+            throw std::runtime_error("MultiArray file type mismatch");
+        std::size_t end;
+        unsigned long long d;
+        try {
+            d=std::stoull(shape.substr(i),&end);
+        } catch(std::out_of_range&) {
+            throw std::runtime_error("MultiArray file type mismatch");
+        }
+        size[j++]=checked_extent(d,count);
+        i+=end;
+    }
+    if(j!=ndim)
+        throw std::runtime_error("MultiArray file type mismatch");
+    if(file_size<length || (file_size-length)/sizeof(T)<count)
+        throw std::runtime_error("Truncated MultiArray file");
+    offset=length;
+    return size;
+}
+
+//p holds at least the header, file_size covers the payload too;
+//fortran tells whether the payload is column-major
+template<typename T, unsigned int ndim>
+std::array<unsigned int,ndim> decode_header(const char* p, std::uint64_t n, std::uint64_t file_size, std::uint64_t& offset, bool& fortran) {
+    fortran=false;
+    if(n>=6 && std::memcmp(p,"\x93NUMPY",6)==0)
+        return read_npy_header<T,ndim>(p,n,file_size,offset,fortran);
+    if(n<data_offset(ndim) && n<file_size)
+        throw std::runtime_error("Truncated MultiArray file");
+    return read_header<T,ndim>(p,file_size,offset);
+}
+
+template<typename T, unsigned int ndim>
+std::string encode_header(const std::array<unsigned int,ndim>& size, io::format f, bool fortran=false) {
+    if(f==io::format::npy)
+        return npy_header<T,ndim>(size,fortran);
+    std::string h(data_offset(ndim),'\0');
+    write_header<T,ndim>(&h[0],size);
+    return h;
+}
+
+//reads and checks the header, leaving the stream at the payload
+template<typename T, unsigned int ndim>
+std::array<unsigned int,ndim> read_header(std::istream& in, std::uint64_t& offset, bool& fortran) {
+    in.seekg(0,std::ios::end);
+    std::uint64_t file_size=static_cast<std::uint64_t>(in.tellg());
+    in.seekg(0);
+    char prefix[12];
+    std::uint64_t n=file_size<sizeof(prefix) ? file_size : sizeof(prefix);
+    if(!in.read(prefix,n))
+        throw std::runtime_error("Cannot read MultiArray file");
+    std::uint64_t length=header_length(prefix,n,ndim);
+    if(length>file_size)
+        throw std::runtime_error("Truncated MultiArray file");
+    std::vector<char> buf(length);
+    std::memcpy(buf.data(),prefix,n<length ? n : length);
+    if(length>n && !in.read(buf.data()+n,length-n))
+        throw std::runtime_error("Cannot read MultiArray file");
+    auto size=decode_header<T,ndim>(buf.data(),length,file_size,offset,fortran);
+    in.seekg(offset);
+    return size;
+}
+
+#ifdef MULTIARRAY_IO_MMAP
+struct unmapper {
+    void* base;
+    std::size_t length;
+    template<typename T>
+    void operator()(T*) const {
+        munmap(base,length);
+    }
+};
+
+//maps a whole file, closing the descriptor either way
+inline void* map_file(int fd, std::size_t length, io::map_mode mode) {
+    void* p=mmap(nullptr,length,PROT_READ|PROT_WRITE,mode==io::map_mode::read_write ? MAP_SHARED : MAP_PRIVATE,fd,0);
+    close(fd);
+    if(p==MAP_FAILED)
+        throw std::runtime_error("Cannot map MultiArray file");
+    return p;
+}
+#endif
+}
+
+namespace io {
+//Maps a file written by create_mapped or save without reading it: pages are
+//loaded on first access. The mapping lives as long as the array or any copy
+//or view of it. Under implicit_cow, writing through a shared copy detaches it
+//into heap memory; use shared_mutable to keep every copy writing to the file.
+template<typename T, unsigned int ndim, typename Policy=implicit_cow>
+MultiArray<T,ndim,std::allocator<T>,Policy> map(const std::string& path, map_mode mode=map_mode::read_only) {
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be mapped");
+#ifdef MULTIARRAY_IO_MMAP
+    int fd=open(path.c_str(),mode==map_mode::read_write ? O_RDWR : O_RDONLY);
+    if(fd<0)
+        throw std::runtime_error("Cannot open MultiArray file");
+    struct stat st;
+    if(fstat(fd,&st)!=0 || st.st_size==0) {
+        close(fd);
+        throw std::runtime_error("Truncated MultiArray file");
+    }
+    std::size_t length=static_cast<std::size_t>(st.st_size);
+    char* base=static_cast<char*>(ioutils::map_file(fd,length,mode));
+    std::uint64_t offset;
+    std::array<unsigned int,ndim> size;
+    bool fortran;
+    try {
+        size=ioutils::decode_header<T,ndim>(base,length,length,offset,fortran);
+    } catch(...) {
+        munmap(base,length);
+        throw;
+    }
+    std::shared_ptr<T> data(reinterpret_cast<T*>(base+offset),ioutils::unmapper{base,length});
+    return MultiArray<T,ndim,std::allocator<T>,Policy>(fortran ? layout<ndim>::column_major() : layout<ndim>::row_major(),size,std::move(data));
+#else
+    (void)path;
+    (void)mode;
+    throw std::runtime_error("Memory mapping is not supported on this platform");
+#endif
+}
+
+//creates (or truncates) a file of the given shape and maps it read-write
+template<typename T, unsigned int ndim, typename Policy=implicit_cow>
+MultiArray<T,ndim,std::allocator<T>,Policy> create_mapped(const std::string& path, const std::array<unsigned int,ndim>& size) {
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be mapped");
+#ifdef MULTIARRAY_IO_MMAP
+    std::uint64_t count=1;
+    for(auto d : size)
+        count*=d;
+    std::uint64_t offset=ioutils::data_offset(ndim);
+    std::size_t length=static_cast<std::size_t>(offset+count*sizeof(T));
+    int fd=open(path.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+    if(fd<0)
+        throw std::runtime_error("Cannot open MultiArray file");
+    if(ftruncate(fd,static_cast<off_t>(length))!=0) {
+        close(fd);
+        throw std::runtime_error("Cannot resize MultiArray file");
+    }
+    char* base=static_cast<char*>(ioutils::map_file(fd,length,map_mode::read_write));
+    ioutils::write_header<T,ndim>(base,size);
+    std::shared_ptr<T> data(reinterpret_cast<T*>(base+offset),ioutils::unmapper{base,length});
+    return MultiArray<T,ndim,std::allocator<T>,Policy>(layout<ndim>::row_major(),size,std::move(data));
+#else
+    (void)path;
+    (void)size;
+    throw std::runtime_error("Memory mapping is not supported on this platform");
+#endif
+}
+
+template<typename T, typename ... Types>
+auto create_mapped(const std::string& path, Types... counts) -> MultiArray<T,sizeof...(Types)> {
+    return create_mapped<T,sizeof...(Types)>(path,std::array<unsigned int,sizeof...(Types)>{{static_cast<unsigned int>(counts)...}});
+}
+
+//header and payload, each in a single write; column-major arrays go to NPY
+//as they are, other non row-major layouts are reordered first
+template<typename T, unsigned int ndim, typename A, typename P>
+void save(const MultiArray<T,ndim,A,P>& a, const std::string& path, format f=format::native) {
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be saved");
+    if(!a.valid())
+        throw std::logic_error("Using invalid MultiArray");
+    if(a.get_layout()!=layout<ndim>::row_major() && (f!=format::npy || a.get_layout()!=layout<ndim>::column_major()))
+        return save(a.view().copy(),path,f);
+    std::string h=ioutils::encode_header<T,ndim>(a.size(),f,a.get_layout()!=layout<ndim>::row_major());
+    std::ofstream out(path,std::ios::binary|std::ios::trunc);
+    if(!out)
+        throw std::runtime_error("Cannot open MultiArray file");
+    out.write(h.data(),h.size());
+    out.write(reinterpret_cast<const char*>(a.data()),a.flat_size()*sizeof(T));
+    if(!out)
+        throw std::runtime_error("Cannot write MultiArray file");
+}
+
+//reads a native or NPY file into memory in one read, Fortran order NPY
+//files give column-major arrays
+template<typename T, unsigned int ndim, typename Allocator=std::allocator<T>, typename Policy=implicit_cow>
+MultiArray<T,ndim,Allocator,Policy> load(const std::string& path) {
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be loaded");
+    std::ifstream in(path,std::ios::binary);
+    if(!in)
+        throw std::runtime_error("Cannot open MultiArray file");
+    std::uint64_t offset;
+    bool fortran;
+    auto size=ioutils::read_header<T,ndim>(in,offset,fortran);
+    MultiArray<T,ndim,Allocator,Policy> a(fortran ? layout<ndim>::column_major() : layout<ndim>::row_major(),size,Allocator());
+    if(!in.read(reinterpret_cast<char*>(a.data()),a.flat_size()*sizeof(T)))
+        throw std::runtime_error("Truncated MultiArray file");
+    return a;
+}
+
+//Streams an array to a file slab by slab along the first dimension, so it
+//never has to be in memory as a whole. The full shape is fixed up front.
+template<typename T, unsigned int ndim>
+class writer
+{
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be saved");
+    std::ofstream out;
+    std::array<unsigned int,ndim> msize;
+    unsigned int rows;
+public:
+    writer(const std::string& path, const std::array<unsigned int,ndim>& size, format f=format::native) :
+        out(path,std::ios::binary|std::ios::trunc), msize(size), rows(0)
+    {
+        if(!out)
+            throw std::runtime_error("Cannot open MultiArray file");
+        std::string h=ioutils::encode_header<T,ndim>(size,f);
+        if(!out.write(h.data(),h.size()))
+            throw std::runtime_error("Cannot write MultiArray file");
+    }
+
+    //appends slab.size()[0] rows, the other extents must match
+    template<typename A, typename P>
+    void write(const MultiArray<T,ndim,A,P>& slab) {
+        if(!slab.valid())
+            throw std::logic_error("Using invalid MultiArray");
+        auto size=slab.size();
+        if(!std::equal(size.begin()+1,size.end(),msize.begin()+1) || size[0]>msize[0]-rows)
+            throw std::invalid_argument("MultiArray shape mismatch");
+        if(slab.get_layout()!=layout<ndim>::row_major())
+            return write(slab.view().copy());
+        if(!out.write(reinterpret_cast<const char*>(slab.data()),slab.flat_size()*sizeof(T)))
+            throw std::runtime_error("Cannot write MultiArray file");
+        rows+=size[0];
+    }
+
+    //rows written so far
+    unsigned int position() const {
+        return rows;
+    }
+
+    //flushes, throws if rows are missing
+    void close() {
+        out.close();
+        if(!out)
+            throw std::runtime_error("Cannot write MultiArray file");
+        if(rows!=msize[0])
+            throw std::runtime_error("Truncated MultiArray file");
+    }
+};
+
+//Reads a native or NPY file slab by slab along the first dimension.
+template<typename T, unsigned int ndim>
+class reader
+{
+    static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable types can be loaded");
+    std::ifstream in;
+    std::array<unsigned int,ndim> msize;
+    unsigned int rows;
+public:
+    explicit reader(const std::string& path) :
+        in(path,std::ios::binary), rows(0)
+    {
+        if(!in)
+            throw std::runtime_error("Cannot open MultiArray file");
+        std::uint64_t offset;
+        bool fortran;
+        msize=ioutils::read_header<T,ndim>(in,offset,fortran);
+        if(fortran && ndim>1) //rows are not contiguous
+            throw std::runtime_error("Unsupported NPY file");
+    }
+
+    //shape of the whole array
+    std::array<unsigned int,ndim> size() const {
+        return msize;
+    }
+
+    //rows read so far
+    unsigned int position() const {
+        return rows;
+    }
+
+    //reads the next count rows (fewer at the end) into slab, reusing its
+    //buffer when the shape fits; returns false once every row has been read
+    template<typename A, typename P>
+    bool read(MultiArray<T,ndim,A,P>& slab, unsigned int count) {
+        if(rows==msize[0] || !count)
+            return false;
+        auto size=msize;
+        size[0]=count<msize[0]-rows ? count : msize[0]-rows;
+        if(!slab.valid() || slab.size()!=size || slab.get_layout()!=layout<ndim>::row_major())
+            slab=MultiArray<T,ndim,A,P>(layout<ndim>::row_major(),size,slab.get_allocator());
+        if(!in.read(reinterpret_cast<char*>(slab.data()),slab.flat_size()*sizeof(T)))
+            throw std::runtime_error("Truncated MultiArray file");
+        rows+=size[0];
+        return true;
+    }
+};
+}
+
+#endif // MULTIARRAY_IO_H
@@ -0,0 +1,354 @@
+#ifndef MULTIARRAY_PARALLEL_H
+#define MULTIARRAY_PARALLEL_H
+
+#include "multiarray.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace parallelutils {
+//work-stealing scheduler internals
+
+typedef unsigned long long int idx_t;
+typedef std::pair<idx_t,idx_t> chunk_t;
+
+//chunks owned by one participant: the owner takes from the front, thieves from the back
+struct queue {
+    std::mutex m;
+    std::deque<chunk_t> chunks;
+
+    bool pop(chunk_t& c) {
+        std::lock_guard<std::mutex> lock(m);
+        if(chunks.empty())
+            return false;
+        c=chunks.front();
+        chunks.pop_front();
+        return true;
+    }
+
+    bool steal(chunk_t& c) {
+        std::lock_guard<std::mutex> lock(m);
+        if(chunks.empty())
+            return false;
+        c=chunks.back();
+        chunks.pop_back();
+        return true;
+    }
+};
+
+struct job {
+    std::function<void(idx_t,idx_t)> f;
+    std::vector<queue> queues;
+    std::atomic<idx_t> remaining;
+    std::atomic<unsigned int> active;
+    std::atomic<bool> failed;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::mutex done_mutex;
+    std::condition_variable done;
+
+    job(unsigned int participants, idx_t n, idx_t grain, std::function<void(idx_t,idx_t)> f) :
+        f(std::move(f)), queues(participants), remaining(0), active(0), failed(false)
+    {
+        //contiguous runs of chunks per participant, so neighbours stay on one core
+        idx_t nchunks=(n+grain-1)/grain;
+        for(idx_t c=0; c<nchunks; ++c) {
+            idx_t first=c*grain, last=first+grain<n ? first+grain : n;
+            queues[c*participants/nchunks].chunks.push_back(chunk_t(first,last));
+        }
+        remaining=nchunks;
+    }
+
+    void execute(const chunk_t& c) {
+        if(!failed) {
+            try {
+                f(c.first,c.second);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error)
+                    error=std::current_exception();
+                failed=true;
+            }
+        }
+        --remaining;
+    }
+
+    void work(unsigned int self) {
+        chunk_t c;
+        while(queues[self].pop(c))
+            execute(c);
+        for(unsigned int k=1; k<queues.size(); ++k) {
+            queue& victim=queues[(self+k)%queues.size()];
+            while(victim.steal(c))
+                execute(c);
+        }
+    }
+
+    //a worker is finished with the job; the last one out wakes the caller.
+    //The decrement happens under done_mutex, so the caller can't return and
+    //destroy the job before the notification is over.
+    void leave() {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        if(--active==0 && !remaining)
+            done.notify_all();
+    }
+
+    //blocks the caller until every chunk ran and every worker left; no worker
+    //can join once the job is no longer current, and only workers hold chunks
+    //once the caller's own work() returned
+    void wait() {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done.wait(lock,[this]{ return !remaining && !active; });
+    }
+};
+
+//true while the calling thread runs a chunk, nested calls then run serially
+inline bool& in_task() {
+    static thread_local bool t=false;
+    return t;
+}
+}
+
+namespace parallel {
+//Fixed set of worker threads; the calling thread takes part in every job.
+//Jobs from different threads are run one at a time.
+class thread_pool
+{
+    typedef parallelutils::idx_t idx_t;
+
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wake;
+    parallelutils::job* current;
+    unsigned long long int generation;
+    bool stopping;
+    std::mutex run_mutex;
+
+    void loop(unsigned int self) {
+        parallelutils::in_task()=true;
+        unsigned long long int seen=0;
+        for(;;) {
+            parallelutils::job* j;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock,[&]{ return stopping || generation!=seen; });
+                if(stopping)
+                    return;
+                seen=generation;
+                j=current;
+                if(!j)
+                    continue;
+                ++j->active;
+            }
+            j->work(self);
+            j->leave();
+        }
+    }
+
+public:
+    explicit thread_pool(unsigned int threads=std::thread::hardware_concurrency()) :
+        current(nullptr), generation(0), stopping(false)
+    {
+        for(unsigned int i=1; i<threads; ++i)
+            workers.emplace_back(&thread_pool::loop,this,i);
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool & operator=(const thread_pool&) = delete;
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping=true;
+        }
+        wake.notify_all();
+        for(auto &t : workers)
+            t.join();
+    }
+
+    //number of threads working on a job, including the caller
+    unsigned int size() const {
+        return static_cast<unsigned int>(workers.size())+1;
+    }
+
+    //calls f(first,last) on chunks of at most grain elements covering [0,n),
+    //returns once all of them are done and rethrows the first exception
+    void run(idx_t n, idx_t grain, std::function<void(idx_t,idx_t)> f) {
+        if(!n)
+            return;
+        if(!grain)
+            grain=1;
+        if(workers.empty() || n<=grain || parallelutils::in_task()) {
+            for(idx_t first=0; first<n; first+=grain)
+                f(first,first+grain<n ? first+grain : n);
+            return;
+        }
+        std::lock_guard<std::mutex> serial(run_mutex);
+        parallelutils::job j(size(),n,grain,std::move(f));
+        {
+            std::lock_guard<std::mutex> lock(m);
+            current=&j;
+            ++generation;
+        }
+        wake.notify_all();
+        parallelutils::in_task()=true;
+        j.work(0);
+        parallelutils::in_task()=false;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            current=nullptr;
+        }
+        j.wait();
+        if(j.error)
+            std::rethrow_exception(j.error);
+    }
+
+    //shared pool with one thread per core
+    static thread_pool& global() {
+        static thread_pool pool;
+        return pool;
+    }
+};
+
+//Reductions are deterministic by default: partial results are combined in
+//buffer order over chunk boundaries that depend only on the grain, so the
+//result does not change with the thread count or scheduling.
+enum class reduction { deterministic, unordered };
+
+//elements per chunk
+const unsigned long long int default_grain=1<<14;
+}
+
+namespace parallelutils {
+template<typename T, unsigned int ndim, typename A, typename P>
+inline void check_valid(const MultiArray<T,ndim,A,P>& a) {
+    if(!a.valid())
+        throw std::logic_error("Using invalid MultiArray");
+}
+
+//multi-index of memory position idx, axes ordered slowest first
+template<unsigned int ndim>
+inline std::array<unsigned int,ndim> unravel(const std::array<unsigned int,ndim>& size, const std::array<unsigned int,ndim>& order, idx_t idx) {
+    std::array<unsigned int,ndim> i;
+    for(unsigned int k=ndim; k-->0;) {
+        unsigned int j=order[k];
+        i[j]=static_cast<unsigned int>(idx%size[j]);
+        idx/=size[j];
+    }
+    return i;
+}
+
+template<unsigned int ndim>
+inline void increment(const std::array<unsigned int,ndim>& size, const std::array<unsigned int,ndim>& order, std::array<unsigned int,ndim>& i) {
+    for(unsigned int k=ndim; k-->0;) {
+        unsigned int j=order[k];
+        if(++i[j]<size[j])
+            return;
+        i[j]=0;
+    }
+}
+}
+
+namespace parallel {
+//f(element) on every element
+template<typename T, unsigned int ndim, typename A, typename P, typename F>
+void for_each(MultiArray<T,ndim,A,P>& a, F f, thread_pool& pool=thread_pool::global(), unsigned long long int grain=default_grain) {
+    parallelutils::check_valid(a);
+    T* p=a.data();
+    pool.run(a.flat_size(),grain,[p,&f](parallelutils::idx_t first, parallelutils::idx_t last) {
+        for(parallelutils::idx_t i=first; i<last; ++i)
+            f(p[i]);
+    });
+}
+
+//dst[i]=f(src[i]), dst may be src
+template<typename T, unsigned int ndim, typename A, typename P, typename U, typename B, typename Q, typename F>
+void transform(const MultiArray<T,ndim,A,P>& src, MultiArray<U,ndim,B,Q>& dst, F f, thread_pool& pool=thread_pool::global(), unsigned long long int grain=default_grain) {
+    parallelutils::check_valid(src);
+    parallelutils::check_valid(dst);
+    if(src.size()!=dst.size())
+        throw std::invalid_argument("MultiArray shape mismatch");
+    if(src.get_layout()!=dst.get_layout())
+        throw std::invalid_argument("MultiArray layout mismatch");
+    const T* s=src.data();
+    U* d=dst.data();
+    if(static_cast<const void*>(&src)==static_cast<const void*>(&dst))
+        s=d;
+    pool.run(src.flat_size(),grain,[s,d,&f](parallelutils::idx_t first, parallelutils::idx_t last) {
+        for(parallelutils::idx_t i=first; i<last; ++i)
+            d[i]=f(s[i]);
+    });
+}
+
+//a(idx)=g(idx) for every multi-index
+template<typename T, unsigned int ndim, typename A, typename P, typename G>
+void generate(MultiArray<T,ndim,A,P>& a, G g, thread_pool& pool=thread_pool::global(), unsigned long long int grain=default_grain) {
+    parallelutils::check_valid(a);
+    T* p=a.data();
+    auto size=a.size();
+    auto order=a.get_layout().order();
+    pool.run(a.flat_size(),grain,[p,&g,&size,&order](parallelutils::idx_t first, parallelutils::idx_t last) {
+        auto idx=parallelutils::unravel<ndim>(size,order,first);
+        for(parallelutils::idx_t i=first; i<last; ++i) {
+            p[i]=g(static_cast<const std::array<unsigned int,ndim>&>(idx));
+            parallelutils::increment<ndim>(size,order,idx);
+        }
+    });
+}
+
+//init op a[0] op a[1] ..., op must be associative
+template<typename T, unsigned int ndim, typename A, typename P, typename V, typename Op>
+V reduce(const MultiArray<T,ndim,A,P>& a, V init, Op op, reduction order=reduction::deterministic,
+         thread_pool& pool=thread_pool::global(), unsigned long long int grain=default_grain) {
+    parallelutils::check_valid(a);
+    const T* p=a.data();
+    parallelutils::idx_t n=a.flat_size();
+    if(!grain)
+        grain=1;
+    if(order==reduction::deterministic) {
+        struct slot { V v; }; //no packed vector<bool>, chunks write concurrently
+        std::vector<slot> partial((n+grain-1)/grain);
+        pool.run(n,grain,[p,grain,&op,&partial](parallelutils::idx_t first, parallelutils::idx_t last) {
+            V s=p[first];
+            for(parallelutils::idx_t i=first+1; i<last; ++i)
+                s=op(s,p[i]);
+            partial[first/grain].v=s;
+        });
+        for(auto &s : partial)
+            init=op(init,s.v);
+        return init;
+    }
+    std::mutex m;
+    pool.run(n,grain,[p,&op,&init,&m](parallelutils::idx_t first, parallelutils::idx_t last) {
+        V s=p[first];
+        for(parallelutils::idx_t i=first+1; i<last; ++i)
+            s=op(s,p[i]);
+        std::lock_guard<std::mutex> lock(m);
+        init=op(init,s);
+    });
+    return init;
+}
+
+//reduction along one axis, split over the kept elements; grain counts elements read
+template<unsigned int axis, typename T, unsigned int ndim, typename A, typename P, typename Op>
+MultiArray<T,ndim-1,A,P> reduce(const MultiArray<T,ndim,A,P>& a, Op op, thread_pool& pool=thread_pool::global(), unsigned long long int grain=default_grain) {
+    static_assert(axis<ndim && ndim>1,"Invalid axis in parallel::reduce<...>(...)");
+    parallelutils::check_valid(a);
+    MultiArray<T,ndim-1,A,P> r(reduceutils::drop_layout<axis>(a.get_layout()),reduceutils::drop_size<axis>(a.size()),a.get_allocator());
+    const T* s=a.data();
+    T* d=r.data();
+    parallelutils::idx_t n=a.size()[axis], inner=a.stride(axis);
+    pool.run(r.flat_size(),grain/n ? grain/n : 1,[s,d,n,inner,&op](parallelutils::idx_t first, parallelutils::idx_t last) {
+        reduceutils::fold(s,d,n,inner,first,last,op);
+    });
+    return r;
+}
+}
+
+#endif // MULTIARRAY_PARALLEL_H
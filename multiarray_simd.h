@@ -0,0 +1,537 @@
+#ifndef MULTIARRAY_SIMD_H
+#define MULTIARRAY_SIMD_H
+
+#include "multiarray.h"
+#include <cstddef>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MULTIARRAY_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace simd {
+//instruction sets, in increasing order
+enum class isa { scalar, sse, avx2, avx512 };
+}
+
+namespace simdutils {
+//explicit SIMD kernels for contiguous float, double and int buffers
+
+template<typename T>
+struct supported : std::integral_constant<bool,std::is_same<T,float>::value ||
+                                               std::is_same<T,double>::value ||
+                                               std::is_same<T,int>::value> {};
+
+//integer kernels wrap around on overflow, like the vector instructions do
+template<typename T>
+inline T wrap_add(T a, T b) {
+    return a+b;
+}
+
+inline int wrap_add(int a, int b) {
+    return int(unsigned(a)+unsigned(b));
+}
+
+template<typename T>
+inline T wrap_mul(T a, T b) {
+    return a*b;
+}
+
+inline int wrap_mul(int a, int b) {
+    return int(unsigned(a)*unsigned(b));
+}
+
+//min and max propagate NaN: a NaN anywhere in the input is the result, on
+//every instruction set and wherever it falls relative to the vector tail
+template<typename T>
+inline T pick_min(T a, T b) {
+    return b<a || b!=b ? b : a;
+}
+
+template<typename T>
+inline T pick_max(T a, T b) {
+    return a<b || b!=b ? b : a;
+}
+
+template<typename T, std::size_t W>
+inline T fold_add(const T (&t)[W]) {
+    T s=t[0];
+    for(std::size_t i=1; i<W; ++i)
+        s=wrap_add(s,t[i]);
+    return s;
+}
+
+template<typename T, std::size_t W>
+inline T fold_min(const T (&t)[W]) {
+    T s=t[0];
+    for(std::size_t i=1; i<W; ++i)
+        s=pick_min(s,t[i]);
+    return s;
+}
+
+template<typename T, std::size_t W>
+inline T fold_max(const T (&t)[W]) {
+    T s=t[0];
+    for(std::size_t i=1; i<W; ++i)
+        s=pick_max(s,t[i]);
+    return s;
+}
+
+inline simd::isa detect() {
+#ifdef MULTIARRAY_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return simd::isa::avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return simd::isa::avx2;
+    if(__builtin_cpu_supports("sse4.1"))
+        return simd::isa::sse;
+#endif
+    return simd::isa::scalar;
+}
+
+inline simd::isa& current() {
+    static simd::isa level=detect();
+    return level;
+}
+
+//plain loops, left to the compiler
+namespace scalar {
+template<typename T>
+T sum(const T* p, std::size_t n) {
+    T s=T(0);
+    for(std::size_t i=0; i<n; ++i)
+        s=wrap_add(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T min(const T* p, std::size_t n) {
+    T s=p[0];
+    for(std::size_t i=1; i<n; ++i)
+        s=pick_min(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T max(const T* p, std::size_t n) {
+    T s=p[0];
+    for(std::size_t i=1; i<n; ++i)
+        s=pick_max(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T dot(const T* x, const T* y, std::size_t n) {
+    T s=T(0);
+    for(std::size_t i=0; i<n; ++i)
+        s=wrap_add(s,wrap_mul(x[i],y[i]));
+    return s;
+}
+
+template<typename T>
+void axpy(T a, const T* x, T* y, std::size_t n) {
+    for(std::size_t i=0; i<n; ++i)
+        y[i]=wrap_add(y[i],wrap_mul(a,x[i]));
+}
+
+template<typename T>
+void scale(T a, T* y, std::size_t n) {
+    for(std::size_t i=0; i<n; ++i)
+        y[i]=wrap_mul(a,y[i]);
+}
+
+template<typename T>
+void fill(T* y, std::size_t n, T value) {
+    for(std::size_t i=0; i<n; ++i)
+        y[i]=value;
+}
+}
+}
+
+#ifdef MULTIARRAY_SIMD_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to=function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+//Vector min(a,b) and max(a,b) for float and double follow pick_min/pick_max:
+//the raw instructions return b when either lane is NaN, so a NaN lane of a
+//is blended back in.
+
+namespace simdutils {
+namespace sse {
+template<typename T>
+struct vec;
+
+template<>
+struct vec<float> {
+    typedef __m128 reg;
+    static const std::size_t width=4;
+    static inline reg load(const float* p) {return _mm_loadu_ps(p);}
+    static inline void store(float* p, reg a) {_mm_storeu_ps(p,a);}
+    static inline reg set1(float v) {return _mm_set1_ps(v);}
+    static inline reg zero() {return _mm_setzero_ps();}
+    static inline reg add(reg a, reg b) {return _mm_add_ps(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm_mul_ps(a,b);}
+    static inline reg min(reg a, reg b) {return _mm_blendv_ps(_mm_min_ps(a,b),a,_mm_cmpunord_ps(a,a));}
+    static inline reg max(reg a, reg b) {return _mm_blendv_ps(_mm_max_ps(a,b),a,_mm_cmpunord_ps(a,a));}
+    static inline float hsum(reg a) {float t[width]; store(t,a); return fold_add(t);}
+    static inline float hmin(reg a) {float t[width]; store(t,a); return fold_min(t);}
+    static inline float hmax(reg a) {float t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<double> {
+    typedef __m128d reg;
+    static const std::size_t width=2;
+    static inline reg load(const double* p) {return _mm_loadu_pd(p);}
+    static inline void store(double* p, reg a) {_mm_storeu_pd(p,a);}
+    static inline reg set1(double v) {return _mm_set1_pd(v);}
+    static inline reg zero() {return _mm_setzero_pd();}
+    static inline reg add(reg a, reg b) {return _mm_add_pd(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm_mul_pd(a,b);}
+    static inline reg min(reg a, reg b) {return _mm_blendv_pd(_mm_min_pd(a,b),a,_mm_cmpunord_pd(a,a));}
+    static inline reg max(reg a, reg b) {return _mm_blendv_pd(_mm_max_pd(a,b),a,_mm_cmpunord_pd(a,a));}
+    static inline double hsum(reg a) {double t[width]; store(t,a); return fold_add(t);}
+    static inline double hmin(reg a) {double t[width]; store(t,a); return fold_min(t);}
+    static inline double hmax(reg a) {double t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<int> {
+    typedef __m128i reg;
+    static const std::size_t width=4;
+    static inline reg load(const int* p) {return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));}
+    static inline void store(int* p, reg a) {_mm_storeu_si128(reinterpret_cast<__m128i*>(p),a);}
+    static inline reg set1(int v) {return _mm_set1_epi32(v);}
+    static inline reg zero() {return _mm_setzero_si128();}
+    static inline reg add(reg a, reg b) {return _mm_add_epi32(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm_mullo_epi32(a,b);}
+    static inline reg min(reg a, reg b) {return _mm_min_epi32(a,b);}
+    static inline reg max(reg a, reg b) {return _mm_max_epi32(a,b);}
+    static inline int hsum(reg a) {int t[width]; store(t,a); return fold_add(t);}
+    static inline int hmin(reg a) {int t[width]; store(t,a); return fold_min(t);}
+    static inline int hmax(reg a) {int t[width]; store(t,a); return fold_max(t);}
+};
+
+#include "multiarray_simd_kernels.h"
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to=function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace simdutils {
+namespace avx2 {
+template<typename T>
+struct vec;
+
+template<>
+struct vec<float> {
+    typedef __m256 reg;
+    static const std::size_t width=8;
+    static inline reg load(const float* p) {return _mm256_loadu_ps(p);}
+    static inline void store(float* p, reg a) {_mm256_storeu_ps(p,a);}
+    static inline reg set1(float v) {return _mm256_set1_ps(v);}
+    static inline reg zero() {return _mm256_setzero_ps();}
+    static inline reg add(reg a, reg b) {return _mm256_add_ps(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm256_mul_ps(a,b);}
+    static inline reg min(reg a, reg b) {return _mm256_blendv_ps(_mm256_min_ps(a,b),a,_mm256_cmp_ps(a,a,_CMP_UNORD_Q));}
+    static inline reg max(reg a, reg b) {return _mm256_blendv_ps(_mm256_max_ps(a,b),a,_mm256_cmp_ps(a,a,_CMP_UNORD_Q));}
+    static inline float hsum(reg a) {float t[width]; store(t,a); return fold_add(t);}
+    static inline float hmin(reg a) {float t[width]; store(t,a); return fold_min(t);}
+    static inline float hmax(reg a) {float t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<double> {
+    typedef __m256d reg;
+    static const std::size_t width=4;
+    static inline reg load(const double* p) {return _mm256_loadu_pd(p);}
+    static inline void store(double* p, reg a) {_mm256_storeu_pd(p,a);}
+    static inline reg set1(double v) {return _mm256_set1_pd(v);}
+    static inline reg zero() {return _mm256_setzero_pd();}
+    static inline reg add(reg a, reg b) {return _mm256_add_pd(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm256_mul_pd(a,b);}
+    static inline reg min(reg a, reg b) {return _mm256_blendv_pd(_mm256_min_pd(a,b),a,_mm256_cmp_pd(a,a,_CMP_UNORD_Q));}
+    static inline reg max(reg a, reg b) {return _mm256_blendv_pd(_mm256_max_pd(a,b),a,_mm256_cmp_pd(a,a,_CMP_UNORD_Q));}
+    static inline double hsum(reg a) {double t[width]; store(t,a); return fold_add(t);}
+    static inline double hmin(reg a) {double t[width]; store(t,a); return fold_min(t);}
+    static inline double hmax(reg a) {double t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<int> {
+    typedef __m256i reg;
+    static const std::size_t width=8;
+    static inline reg load(const int* p) {return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));}
+    static inline void store(int* p, reg a) {_mm256_storeu_si256(reinterpret_cast<__m256i*>(p),a);}
+    static inline reg set1(int v) {return _mm256_set1_epi32(v);}
+    static inline reg zero() {return _mm256_setzero_si256();}
+    static inline reg add(reg a, reg b) {return _mm256_add_epi32(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm256_mullo_epi32(a,b);}
+    static inline reg min(reg a, reg b) {return _mm256_min_epi32(a,b);}
+    static inline reg max(reg a, reg b) {return _mm256_max_epi32(a,b);}
+    static inline int hsum(reg a) {int t[width]; store(t,a); return fold_add(t);}
+    static inline int hmin(reg a) {int t[width]; store(t,a); return fold_min(t);}
+    static inline int hmax(reg a) {int t[width]; store(t,a); return fold_max(t);}
+};
+
+#include "multiarray_simd_kernels.h"
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to=function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+//GCC's own min/max intrinsics trip this warning
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace simdutils {
+namespace avx512 {
+template<typename T>
+struct vec;
+
+template<>
+struct vec<float> {
+    typedef __m512 reg;
+    static const std::size_t width=16;
+    static inline reg load(const float* p) {return _mm512_loadu_ps(p);}
+    static inline void store(float* p, reg a) {_mm512_storeu_ps(p,a);}
+    static inline reg set1(float v) {return _mm512_set1_ps(v);}
+    static inline reg zero() {return _mm512_setzero_ps();}
+    static inline reg add(reg a, reg b) {return _mm512_add_ps(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm512_mul_ps(a,b);}
+    static inline reg min(reg a, reg b) {return _mm512_mask_mov_ps(_mm512_min_ps(a,b),_mm512_cmp_ps_mask(a,a,_CMP_UNORD_Q),a);}
+    static inline reg max(reg a, reg b) {return _mm512_mask_mov_ps(_mm512_max_ps(a,b),_mm512_cmp_ps_mask(a,a,_CMP_UNORD_Q),a);}
+    static inline float hsum(reg a) {float t[width]; store(t,a); return fold_add(t);}
+    static inline float hmin(reg a) {float t[width]; store(t,a); return fold_min(t);}
+    static inline float hmax(reg a) {float t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<double> {
+    typedef __m512d reg;
+    static const std::size_t width=8;
+    static inline reg load(const double* p) {return _mm512_loadu_pd(p);}
+    static inline void store(double* p, reg a) {_mm512_storeu_pd(p,a);}
+    static inline reg set1(double v) {return _mm512_set1_pd(v);}
+    static inline reg zero() {return _mm512_setzero_pd();}
+    static inline reg add(reg a, reg b) {return _mm512_add_pd(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm512_mul_pd(a,b);}
+    static inline reg min(reg a, reg b) {return _mm512_mask_mov_pd(_mm512_min_pd(a,b),_mm512_cmp_pd_mask(a,a,_CMP_UNORD_Q),a);}
+    static inline reg max(reg a, reg b) {return _mm512_mask_mov_pd(_mm512_max_pd(a,b),_mm512_cmp_pd_mask(a,a,_CMP_UNORD_Q),a);}
+    static inline double hsum(reg a) {double t[width]; store(t,a); return fold_add(t);}
+    static inline double hmin(reg a) {double t[width]; store(t,a); return fold_min(t);}
+    static inline double hmax(reg a) {double t[width]; store(t,a); return fold_max(t);}
+};
+
+template<>
+struct vec<int> {
+    typedef __m512i reg;
+    static const std::size_t width=16;
+    static inline reg load(const int* p) {return _mm512_loadu_si512(p);}
+    static inline void store(int* p, reg a) {_mm512_storeu_si512(p,a);}
+    static inline reg set1(int v) {return _mm512_set1_epi32(v);}
+    static inline reg zero() {return _mm512_setzero_si512();}
+    static inline reg add(reg a, reg b) {return _mm512_add_epi32(a,b);}
+    static inline reg mul(reg a, reg b) {return _mm512_mullo_epi32(a,b);}
+    static inline reg min(reg a, reg b) {return _mm512_min_epi32(a,b);}
+    static inline reg max(reg a, reg b) {return _mm512_max_epi32(a,b);}
+    static inline int hsum(reg a) {int t[width]; store(t,a); return fold_add(t);}
+    static inline int hmin(reg a) {int t[width]; store(t,a); return fold_min(t);}
+    static inline int hmax(reg a) {int t[width]; store(t,a); return fold_max(t);}
+};
+
+#include "multiarray_simd_kernels.h"
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+#endif // MULTIARRAY_SIMD_X86
+
+namespace simd {
+
+inline isa detected() {
+    static const isa level=simdutils::detect();
+    return level;
+}
+
+inline isa active() {
+    return simdutils::current();
+}
+
+//restricts dispatch to at most the given instruction set, mainly for
+//testing and benchmarking; not thread-safe
+inline isa set_isa(isa level) {
+    if(level>detected())
+        level=detected();
+    return simdutils::current()=level;
+}
+
+#ifdef MULTIARRAY_SIMD_X86
+#define MULTIARRAY_SIMD_DISPATCH(call) \
+    switch(active()) { \
+    case isa::avx512: return simdutils::avx512::call; \
+    case isa::avx2: return simdutils::avx2::call; \
+    case isa::sse: return simdutils::sse::call; \
+    default: return simdutils::scalar::call; \
+    }
+#else
+#define MULTIARRAY_SIMD_DISPATCH(call) \
+    return simdutils::scalar::call;
+#endif
+
+//pointer-based
+
+template<typename T>
+T sum(const T* p, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::sum(...)");
+    MULTIARRAY_SIMD_DISPATCH(sum(p,n))
+}
+
+template<typename T>
+T min(const T* p, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::min(...)");
+    //kernels seed from p[0]; an empty range yields the identity
+    if(n==0)
+        return std::numeric_limits<T>::max();
+    MULTIARRAY_SIMD_DISPATCH(min(p,n))
+}
+
+template<typename T>
+T max(const T* p, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::max(...)");
+    if(n==0)
+        return std::numeric_limits<T>::lowest();
+    MULTIARRAY_SIMD_DISPATCH(max(p,n))
+}
+
+template<typename T>
+T dot(const T* x, const T* y, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::dot(...)");
+    MULTIARRAY_SIMD_DISPATCH(dot(x,y,n))
+}
+
+template<typename T>
+auto norm(const T* p, std::size_t n) -> decltype(std::sqrt(T())) {
+    return std::sqrt(dot(p,p,n));
+}
+
+//y+=a*x
+template<typename T>
+void axpy(T a, const T* x, T* y, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::axpy(...)");
+    MULTIARRAY_SIMD_DISPATCH(axpy(a,x,y,n))
+}
+
+//y*=a
+template<typename T>
+void scale(T a, T* y, std::size_t n) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::scale(...)");
+    MULTIARRAY_SIMD_DISPATCH(scale(a,y,n))
+}
+
+template<typename T>
+void fill(T* y, std::size_t n, T value) {
+    static_assert(simdutils::supported<T>::value,"Unsupported type in simd::fill(...)");
+    MULTIARRAY_SIMD_DISPATCH(fill(y,n,value))
+}
+
+#undef MULTIARRAY_SIMD_DISPATCH
+
+//MultiArray-based
+
+template<typename T, unsigned int ndim, typename A, typename P>
+inline const T* checked_data(const MultiArray<T,ndim,A,P>& a) {
+    if(!a.valid())
+        throw std::logic_error("Using invalid MultiArray");
+    return a.data();
+}
+
+template<typename T, unsigned int ndim, typename A, typename P, typename B, typename Q>
+inline void check_shape(const MultiArray<T,ndim,A,P>& a, const MultiArray<T,ndim,B,Q>& b) {
+    if(a.size()!=b.size())
+        throw std::invalid_argument("MultiArray shape mismatch");
+    //flat kernels pair elements by memory position
+    if(a.get_layout()!=b.get_layout())
+        throw std::invalid_argument("MultiArray layout mismatch");
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+T sum(const MultiArray<T,ndim,A,P>& a) {
+    return sum(checked_data(a),a.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+T min(const MultiArray<T,ndim,A,P>& a) {
+    return min(checked_data(a),a.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+T max(const MultiArray<T,ndim,A,P>& a) {
+    return max(checked_data(a),a.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P, typename B, typename Q>
+T dot(const MultiArray<T,ndim,A,P>& x, const MultiArray<T,ndim,B,Q>& y) {
+    check_shape(x,y);
+    return dot(checked_data(x),checked_data(y),x.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+auto norm(const MultiArray<T,ndim,A,P>& a) -> decltype(std::sqrt(T())) {
+    return norm(checked_data(a),a.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P, typename B, typename Q>
+void axpy(T a, const MultiArray<T,ndim,A,P>& x, MultiArray<T,ndim,B,Q>& y) {
+    check_shape(x,y);
+    const T* px=checked_data(x);
+    axpy(a,px,y.data(),y.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+void scale(T a, MultiArray<T,ndim,A,P>& y) {
+    checked_data(y);
+    scale(a,y.data(),y.flat_size());
+}
+
+template<typename T, unsigned int ndim, typename A, typename P>
+void fill(MultiArray<T,ndim,A,P>& y, T value) {
+    checked_data(y);
+    fill(y.data(),y.flat_size(),value);
+}
+}
+
+#endif // MULTIARRAY_SIMD_H
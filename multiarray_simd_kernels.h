@@ -0,0 +1,99 @@
+//Kernels shared by the vector instruction sets. There is deliberately no include
+//guard: multiarray_simd.h includes this once per instruction set, inside a
+//namespace that defines vec<T> and under the matching target options.
+//min and max need n>0: they seed from p[0], not from numeric_limits, which
+//would turn an all-infinite input into a finite result. The accumulator is
+//the first operand of V::min/V::max, so a NaN it holds is kept.
+
+template<typename T>
+T sum(const T* p, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg a0=V::zero(), a1=V::zero();
+    std::size_t i=0;
+    for(; i+2*V::width<=n; i+=2*V::width) {
+        a0=V::add(a0,V::load(p+i));
+        a1=V::add(a1,V::load(p+i+V::width));
+    }
+    for(; i+V::width<=n; i+=V::width)
+        a0=V::add(a0,V::load(p+i));
+    T s=V::hsum(V::add(a0,a1));
+    for(; i<n; ++i)
+        s=wrap_add(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T min(const T* p, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg a=V::set1(p[0]);
+    std::size_t i=0;
+    for(; i+V::width<=n; i+=V::width)
+        a=V::min(a,V::load(p+i));
+    T s=V::hmin(a);
+    for(; i<n; ++i)
+        s=pick_min(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T max(const T* p, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg a=V::set1(p[0]);
+    std::size_t i=0;
+    for(; i+V::width<=n; i+=V::width)
+        a=V::max(a,V::load(p+i));
+    T s=V::hmax(a);
+    for(; i<n; ++i)
+        s=pick_max(s,p[i]);
+    return s;
+}
+
+template<typename T>
+T dot(const T* x, const T* y, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg a0=V::zero(), a1=V::zero();
+    std::size_t i=0;
+    for(; i+2*V::width<=n; i+=2*V::width) {
+        a0=V::add(a0,V::mul(V::load(x+i),V::load(y+i)));
+        a1=V::add(a1,V::mul(V::load(x+i+V::width),V::load(y+i+V::width)));
+    }
+    for(; i+V::width<=n; i+=V::width)
+        a0=V::add(a0,V::mul(V::load(x+i),V::load(y+i)));
+    T s=V::hsum(V::add(a0,a1));
+    for(; i<n; ++i)
+        s=wrap_add(s,wrap_mul(x[i],y[i]));
+    return s;
+}
+
+template<typename T>
+void axpy(T a, const T* x, T* y, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg va=V::set1(a);
+    std::size_t i=0;
+    for(; i+V::width<=n; i+=V::width)
+        V::store(y+i,V::add(V::load(y+i),V::mul(va,V::load(x+i))));
+    for(; i<n; ++i)
+        y[i]=wrap_add(y[i],wrap_mul(a,x[i]));
+}
+
+template<typename T>
+void scale(T a, T* y, std::size_t n) {
+    typedef vec<T> V;
+    typename V::reg va=V::set1(a);
+    std::size_t i=0;
+    for(; i+V::width<=n; i+=V::width)
+        V::store(y+i,V::mul(va,V::load(y+i)));
+    for(; i<n; ++i)
+        y[i]=wrap_mul(a,y[i]);
+}
+
+template<typename T>
+void fill(T* y, std::size_t n, T value) {
+    typedef vec<T> V;
+    typename V::reg v=V::set1(value);
+    std::size_t i=0;
+    for(; i+V::width<=n; i+=V::width)
+        V::store(y+i,v);
+    for(; i<n; ++i)
+        y[i]=value;
+}
@@ -0,0 +1,300 @@
+#ifndef MULTIARRAY_SPARSE_H
+#define MULTIARRAY_SPARSE_H
+
+#include "multiarray.h"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+namespace sparseutils {
+//storage helpers
+
+typedef unsigned long long int idx_t;
+
+//a block covers 1<<block_bits consecutive row-major flat indices
+const unsigned int block_bits=12;
+const idx_t block_mask=(idx_t(1)<<block_bits)-1;
+
+//non-zeros of one block, sorted by offset within the block
+template<typename T>
+struct block {
+    std::vector<std::uint16_t> offsets;
+    std::vector<T> values;
+
+    //position of offset o, or of the first larger one
+    std::size_t find(std::uint16_t o) const {
+        return std::lower_bound(offsets.begin(),offsets.end(),o)-offsets.begin();
+    }
+};
+}
+
+//Mostly-zero arrays: only non-zero elements are stored, in blocks of
+//consecutive row-major flat indices kept in a hash map, each a sorted list of
+//offsets and values. Build in bulk with coo, read with get(...) like
+//MultiArray, iterate over the non-zeros only. Elements equal to T() are zeros.
+template<typename T, unsigned int ndim>
+class SparseMultiArray
+{
+public:
+    typedef unsigned long long int idx_t;
+    typedef unsigned int smallidx_t;
+    typedef std::array<smallidx_t,ndim> multiIdx_t;
+    typedef typename sequtils::gens<ndim>::type idxseq;
+private:
+    static_assert(ndim>0,"SparseMultiArray needs at least one dimension");
+    typedef sparseutils::block<T> block_t;
+    typedef std::unordered_map<idx_t,block_t> blocks_t;
+
+    multiIdx_t msize;
+    idx_t arr_size;
+    idx_t nonzeros;
+    blocks_t blocks;
+    T zero;
+
+    idx_t index(const multiIdx_t& idx) const {
+        idx_t i=0;
+        for(smallidx_t j=0; j<ndim; ++j) {
+            if(idx[j]>=msize[j])
+                throw std::out_of_range("MultiArray index out of range");
+            i=i*msize[j]+idx[j];
+        }
+        return i;
+    }
+
+    multiIdx_t unravel(idx_t i) const {
+        multiIdx_t idx;
+        for(smallidx_t j=ndim; j-->0;) {
+            idx[j]=i%msize[j];
+            i/=msize[j];
+        }
+        return idx;
+    }
+
+    void init(const multiIdx_t& size) {
+        msize=size;
+        arr_size=1;
+        for(auto i : msize)
+            arr_size*=i;
+    }
+
+    template<typename ... Types>
+    static multiIdx_t make_idx(Types... indexes) {
+        return multiIdx_t{{smallidx_t(indexes)...}};
+    }
+
+public:
+    //bulk construction: add entries in any order, the last one added for an
+    //index wins, then hand the list to the SparseMultiArray constructor
+    class coo
+    {
+        friend class SparseMultiArray;
+        multiIdx_t msize;
+        std::vector<std::pair<idx_t,T> > entries;
+    public:
+        explicit coo(const multiIdx_t& size) : msize(size) {}
+
+        void reserve(idx_t n) {
+            entries.reserve(n);
+        }
+
+        void add(const multiIdx_t& idx, const T& value) {
+            idx_t i=0;
+            for(smallidx_t j=0; j<ndim; ++j) {
+                if(idx[j]>=msize[j])
+                    throw std::out_of_range("MultiArray index out of range");
+                i=i*msize[j]+idx[j];
+            }
+            entries.emplace_back(i,value);
+        }
+
+        idx_t size() const {
+            return entries.size();
+        }
+    };
+
+    explicit SparseMultiArray(const multiIdx_t& size) : nonzeros(0), zero() {
+        init(size);
+    }
+
+    template<typename ... Types>
+    explicit SparseMultiArray(smallidx_t count, Types... counts) : nonzeros(0), zero() {
+        static_assert(sizeof...(counts)+1==ndim,"Invalid number of arguments in SparseMultiArray::SparseMultiArray(...)");
+        init(make_idx(count,counts...));
+    }
+
+    explicit SparseMultiArray(coo entries) : nonzeros(0), zero() {
+        init(entries.msize);
+        auto& e=entries.entries;
+        std::stable_sort(e.begin(),e.end(),[](const std::pair<idx_t,T>& a, const std::pair<idx_t,T>& b) { return a.first<b.first; });
+        for(std::size_t k=0; k<e.size(); ++k) {
+            if(k+1<e.size() && e[k+1].first==e[k].first)
+                continue;
+            if(e[k].second==zero)
+                continue;
+            block_t& b=blocks[e[k].first>>sparseutils::block_bits];
+            b.offsets.push_back(std::uint16_t(e[k].first&sparseutils::block_mask));
+            b.values.push_back(e[k].second);
+            ++nonzeros;
+        }
+    }
+
+    template<typename A, typename P>
+    explicit SparseMultiArray(const MultiArray<T,ndim,A,P>& dense) : nonzeros(0), zero() {
+        init(dense.size());
+        for(auto i=dense.const_begin(); i!=dense.const_end(); ++i)
+            if(*i!=zero)
+                set(i.index(),*i);
+    }
+
+    //dense copy, zeros filled with T()
+    MultiArray<T,ndim> to_dense() const {
+        MultiArray<T,ndim> result=make_array<T>(msize);
+        std::fill(result.begin(),result.end(),zero);
+        T* dst=result.data();
+        for(auto &kv : blocks) {
+            T* base=dst+(kv.first<<sparseutils::block_bits);
+            for(std::size_t k=0; k<kv.second.offsets.size(); ++k)
+                base[kv.second.offsets[k]]=kv.second.values[k];
+        }
+        return result;
+    }
+
+    //access, absent elements read as T()
+
+    const T& get(const multiIdx_t& idx) const {
+        const idx_t i=index(idx);
+        auto it=blocks.find(i>>sparseutils::block_bits);
+        if(it==blocks.end())
+            return zero;
+        const block_t& b=it->second;
+        const std::uint16_t o=std::uint16_t(i&sparseutils::block_mask);
+        const std::size_t k=b.find(o);
+        return k<b.offsets.size() && b.offsets[k]==o ? b.values[k] : zero;
+    }
+
+    template<typename ... Types>
+    const T& get(Types... indexes) const {
+        static_assert(sizeof...(indexes)==ndim,"Invalid number of arguments in SparseMultiArray::get(...)");
+        return get(make_idx(indexes...));
+    }
+
+    const T& operator()(const multiIdx_t& idx) const {
+        return get(idx);
+    }
+
+    template<typename ... Types>
+    const T& operator()(Types... indexes) const {
+        return get(indexes...);
+    }
+
+    //stores value, or removes the element when value is T()
+    void set(const multiIdx_t& idx, const T& value) {
+        const idx_t i=index(idx);
+        const idx_t key=i>>sparseutils::block_bits;
+        const std::uint16_t o=std::uint16_t(i&sparseutils::block_mask);
+        auto it=blocks.find(key);
+        if(value==zero) {
+            if(it==blocks.end())
+                return;
+            block_t& b=it->second;
+            const std::size_t k=b.find(o);
+            if(k==b.offsets.size() || b.offsets[k]!=o)
+                return;
+            b.offsets.erase(b.offsets.begin()+k);
+            b.values.erase(b.values.begin()+k);
+            --nonzeros;
+            if(b.offsets.empty())
+                blocks.erase(it);
+            return;
+        }
+        block_t& b=it==blocks.end() ? blocks[key] : it->second;
+        const std::size_t k=b.find(o);
+        if(k<b.offsets.size() && b.offsets[k]==o) {
+            b.values[k]=value;
+            return;
+        }
+        b.offsets.insert(b.offsets.begin()+k,o);
+        b.values.insert(b.values.begin()+k,value);
+        ++nonzeros;
+    }
+
+    //utility
+
+    multiIdx_t size() const {
+        return msize;
+    }
+
+    idx_t flat_size() const {
+        return arr_size;
+    }
+
+    //number of stored elements
+    idx_t nnz() const {
+        return nonzeros;
+    }
+
+    //iterators visit the non-zeros only, a block at a time in no particular
+    //order and row-major within a block
+
+    class const_iterator
+    {
+    protected:
+        friend class SparseMultiArray;
+        const SparseMultiArray* arr;
+        typename blocks_t::const_iterator block;
+        std::size_t k;
+        const_iterator(const SparseMultiArray* arr, typename blocks_t::const_iterator block) : arr(arr), block(block), k(0) {}
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator() : arr(nullptr), block(), k(0) {}
+
+        const_iterator& operator++() {
+            if(++k==block->second.offsets.size()) {
+                ++block;
+                k=0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {const_iterator tmp(*this); operator++(); return tmp;}
+        bool operator==(const const_iterator& rhs) const {return !(*this!=rhs);}
+        bool operator!=(const const_iterator& rhs) const {return arr!=rhs.arr || block!=rhs.block || k!=rhs.k;}
+
+        reference operator*() const {
+            if(block==arr->blocks.end())
+                throw std::out_of_range("MultiArray index out of range");
+            return block->second.values[k];
+        }
+        pointer operator->() const {return &**this;}
+
+        const SparseMultiArray* parent() const { return arr; }
+        idx_t flat_index() const {
+            return (block->first<<sparseutils::block_bits)+block->second.offsets[k];
+        }
+        const multiIdx_t index() const {
+            return arr->unravel(flat_index());
+        }
+    };
+
+    const_iterator begin() const {
+        return const_begin();
+    }
+
+    const_iterator end() const {
+        return const_end();
+    }
+
+    const_iterator const_begin() const {
+        return const_iterator(this,blocks.begin());
+    }
+
+    const_iterator const_end() const {
+        return const_iterator(this,blocks.end());
+    }
+};
+
+#endif // MULTIARRAY_SPARSE_H
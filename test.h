@@ -2,7 +2,15 @@
 #define TEST_H
 
 #include "multiarray.h"
+#include "multiarray_simd.h"
+#include "multiarray_alloc.h"
+#include "multiarray_fixed.h"
+#include "multiarray_parallel.h"
+#include "multiarray_io.h"
+#include "multiarray_sparse.h"
+#include "multiarray_blocked.h"
 #include <vector>
+#include <algorithm>
 #include <random>
 #include <cassert>
 #include <iostream>
@@ -10,12 +18,36 @@
 template<typename T,typename ... Types>
 class Test;
 
+//moves every axis one place forward
+template<typename T, unsigned int ndim, unsigned int ... I>
+MultiArrayView<T,ndim> rotate(const MultiArrayView<T,ndim>& v, sequtils::seq<I...>) {
+    return v.template permute<((I+1)%ndim)...>();
+}
+
+inline bool simd_close(int a, int b) {
+    return a==b;
+}
+
+inline bool simd_close(float a, float b) {
+    return std::abs(a-b)<=1e-4f*std::max(std::abs(a),std::abs(b));
+}
+
+inline bool simd_close(double a, double b) {
+    return std::abs(a-b)<=1e-12*std::max(std::abs(a),std::abs(b));
+}
+
 template<typename T,typename D>
 void test_slice_2(Test<T,D>&) {}
 
 template<typename T,typename ... Types>
 void test_slice_2(Test<T,Types...> &test);
 
+template<typename T,typename D>
+void test_reduce(Test<T,D>&) {}
+
+template<typename T,typename ... Types>
+void test_reduce(Test<T,Types...> &test);
+
 template<typename T,typename D>
 void test_slice_3(Test<T,D>&) {}
 
@@ -70,6 +102,7 @@ private:
 
     friend void test_slice_2<>(Test&);
     friend void test_slice_3<>(Test&);
+    friend void test_reduce<>(Test&);
 
 public:
     Test(Types... counts) : ma(counts...),count({{counts...}}) {
@@ -116,6 +149,393 @@ public:
             }
             assert(vi==vi_max);
         }
+        //nd iterator check
+        {
+            vi=0;
+            auto j=ma.const_begin();
+            for(auto i=ma.const_nd_begin(); i!=ma.const_nd_end(); ++i, ++j) {
+                assert(i.index()==j.index());
+                assert(*i==values[vi++]);
+            }
+            assert(vi==vi_max);
+        }
+        //random access check
+        {
+#if __cplusplus >= 202002L
+            static_assert(std::contiguous_iterator<typename decltype(ma)::iterator>,"");
+            static_assert(std::contiguous_iterator<typename decltype(ma)::const_iterator>,"");
+#endif
+            const auto &cma=ma;
+            assert(cma.const_end()-cma.const_begin()==std::ptrdiff_t(size));
+            assert(cma.const_begin()[size-1]==values[size-1]);
+            assert(*(cma.const_end()-1)==values[size-1]);
+            assert(cma.const_begin()<cma.const_end());
+            auto sorted=ma; //shallow copy, begin() should cow
+            std::sort(sorted.begin(),sorted.end());
+            auto svalues=values;
+            std::sort(svalues.begin(),svalues.end());
+            assert(std::equal(svalues.begin(),svalues.end(),sorted.const_begin()));
+            auto key=svalues[size/2];
+            assert(std::lower_bound(sorted.const_begin(),sorted.const_end(),key)-sorted.const_begin()==
+                   std::lower_bound(svalues.begin(),svalues.end(),key)-svalues.begin());
+            assert(std::equal(values.begin(),values.end(),cma.const_begin()));
+        }
+        //unchecked access check
+        {
+            const auto ca=ma; //shallow copy
+            const auto &cma=ma;
+            assert(cma.data()==ca.data());
+            ma.reserve_unique(); //should cow once
+            assert(cma.data()!=ca.data());
+            T* p=ma.data();
+            assert(p==cma.data());
+            vi=0;
+            for(auto i=ma.const_begin(); i!=ma.const_end(); ++i, ++vi) {
+                assert(ma.at_unchecked(i.index())==values[vi]);
+                assert(cma.at_unchecked(i.index())==values[vi]);
+                assert(p[vi]==values[vi]);
+            }
+            assert(vi==vi_max);
+        }
+        //arithmetic check
+        {
+            decltype(ma) res=ma-ma/T(2)+T(1);
+            vi=0;
+            for(auto i=res.const_begin(); i!=res.const_end(); ++i, ++vi) {
+                assert(*i==T(values[vi]-values[vi]/T(2)+T(1)));
+            }
+            assert(vi==vi_max);
+            res=abs(-ma)*T(1); //same shape, written in place
+            assert(std::equal(values.begin(),values.end(),res.const_begin()));
+            auto cp=ma; //shallow copy, should not write through
+            cp-=ma;
+            assert(std::equal(values.begin(),values.end(),ma.const_begin()));
+            for(auto i=cp.const_begin(); i!=cp.const_end(); ++i) {
+                assert(*i==T(0));
+            }
+            auto lazy=(ma+cp).eval();
+            assert(std::equal(values.begin(),values.end(),lazy.const_begin()));
+            bool pass=false;
+            try {
+                auto other=ma.slice(std::tuple_cat(std::make_tuple(range{0,1}),
+                                                   make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type()))).copy();
+                res=ma+other;
+            } catch (std::invalid_argument &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray shape mismatch");
+            }
+            assert(pass);
+        }
+        //simd kernel check, every available instruction set against scalar results
+        {
+            using simdutils::wrap_add;
+            using simdutils::wrap_mul;
+            const auto &cma=ma;
+            T rsum=values[0], rmin=values[0], rmax=values[0], rdot=wrap_mul(values[0],values[0]);
+            for(idx_t k=1; k<size; ++k) {
+                rsum=wrap_add(rsum,values[k]);
+                rmin=std::min(rmin,values[k]);
+                rmax=std::max(rmax,values[k]);
+                rdot=wrap_add(rdot,wrap_mul(values[k],values[k]));
+            }
+            for(int l=0; l<=int(simd::detected()); ++l) {
+                assert(simd::set_isa(simd::isa(l))==simd::isa(l));
+                assert(simd_close(simd::sum(cma),rsum));
+                assert(simd::min(cma)==rmin);
+                assert(simd::max(cma)==rmax);
+                assert(simd_close(simd::dot(cma,cma),rdot));
+                auto nrm=simd::norm(cma), rnrm=std::sqrt(simd::dot(cma,cma));
+                assert(nrm==rnrm || (nrm!=nrm && rnrm!=rnrm)); //wrapped int dot can be negative
+                auto y=ma; //shallow copy, axpy should cow
+                simd::axpy(T(2),cma,y);
+                assert(std::equal(values.begin(),values.end(),cma.const_begin()));
+                simd::scale(T(3),y);
+                vi=0;
+                for(auto i=y.const_begin(); i!=y.const_end(); ++i, ++vi) {
+                    assert(simd_close(*i,wrap_mul(T(3),wrap_add(values[vi],wrap_mul(T(2),values[vi])))));
+                }
+                assert(vi==vi_max);
+                simd::fill(y,T(7));
+                for(auto i=y.const_begin(); i!=y.const_end(); ++i) {
+                    assert(*i==T(7));
+                }
+            }
+            //infinities: min and max must not be clamped to numeric_limits
+            if(std::numeric_limits<T>::has_infinity) {
+                const T inf=std::numeric_limits<T>::infinity();
+                auto pinf=ma.view().copy(), ninf=ma.view().copy(), mixed=ma.view().copy();
+                simd::fill(pinf,inf);
+                simd::fill(ninf,-inf);
+                *(mixed.begin()+size/2)=-inf;
+                *(mixed.end()-1)=inf;
+                for(int l=0; l<=int(simd::detected()); ++l) {
+                    simd::set_isa(simd::isa(l));
+                    assert(simd::min(pinf)==inf && simd::max(pinf)==inf);
+                    assert(simd::min(ninf)==-inf && simd::max(ninf)==-inf);
+                    assert(simd::min(mixed)==-inf && simd::max(mixed)==inf);
+                    *(mixed.begin()+size/2)=values[size/2];
+                    assert(simd::min(mixed)==*std::min_element(mixed.const_begin(),mixed.const_end()));
+                    *(mixed.begin()+size/2)=-inf;
+                }
+                simd::set_isa(simd::detected());
+            }
+            //NaN propagates, wherever it falls: first, in the vector body, in the tail
+            if(std::numeric_limits<T>::has_quiet_NaN) {
+                const T nan=std::numeric_limits<T>::quiet_NaN();
+                for(idx_t pos : {idx_t(0),size/2,size-1}) {
+                    auto withnan=ma.view().copy();
+                    *(withnan.begin()+pos)=nan;
+                    for(int l=0; l<=int(simd::detected()); ++l) {
+                        simd::set_isa(simd::isa(l));
+                        const T mn=simd::min(withnan), mx=simd::max(withnan);
+                        assert(mn!=mn && mx!=mx);
+                    }
+                }
+                simd::set_isa(simd::detected());
+            }
+        }
+        //allocator check
+        {
+            MultiArray<T,sizeof...(Types),aligned_allocator<T>> al(ma.view());
+            assert(reinterpret_cast<std::uintptr_t>(al.data())%64==0);
+            assert(std::equal(values.begin(),values.end(),al.const_begin()));
+            auto cl=al; //shallow copy, write should detach into aligned storage
+            *cl.begin()=T(0);
+            assert(cl.data()!=al.data());
+            assert(reinterpret_cast<std::uintptr_t>(cl.data())%64==0);
+            assert(std::equal(values.begin(),values.end(),al.const_begin()));
+            assert(simd_close(simd::sum(al),simd::sum(ma)));
+
+            MultiArray<T,sizeof...(Types),hugepage_allocator<T>> hl(ma.view());
+            assert(std::equal(values.begin(),values.end(),hl.const_begin()));
+            const idx_t n=hugepage_allocator<T>::huge_page/sizeof(T)+1;
+            MultiArray<T,1,hugepage_allocator<T>> big(n);
+            assert(reinterpret_cast<std::uintptr_t>(big.data())%hugepage_allocator<T>::huge_page==0);
+            big.at_unchecked(n-1)=T(1);
+            assert(big.at_unchecked(n-1)==T(1));
+
+            arena ar(4096);
+            for(int k=0; k<2; ++k) { //second round reuses the released chunks
+                arena_scope scope(ar);
+                MultiArray<T,sizeof...(Types),arena_allocator<T>> tmp(ma.view());
+                assert(tmp.get_allocator().get_arena()==&ar);
+                assert(std::equal(values.begin(),values.end(),tmp.const_begin()));
+                auto cp=tmp; //shallow copy, write should detach inside the arena
+                *cp.begin()=T(0);
+                assert(cp.get_allocator().get_arena()==&ar);
+                assert(std::equal(values.begin(),values.end(),tmp.const_begin()));
+                decltype(tmp) half=tmp-tmp/T(2);
+                vi=0;
+                for(auto i=half.const_begin(); i!=half.const_end(); ++i, ++vi) {
+                    assert(*i==T(values[vi]-values[vi]/T(2)));
+                }
+                assert(vi==vi_max);
+                tmp.clear();
+                cp.clear();
+                half.clear();
+                ar.release();
+            }
+            MultiArray<T,sizeof...(Types),arena_allocator<T>> heap(ma.view());
+            assert(heap.get_allocator().get_arena()==nullptr);
+            assert(std::equal(values.begin(),values.end(),heap.const_begin()));
+            //assigning an expression of another shape reallocates from the same arena
+            std::array<unsigned int,sizeof...(Types)> ones;
+            ones.fill(1);
+            MultiArray<T,sizeof...(Types),arena_allocator<T>> grown(layout<sizeof...(Types)>::row_major(),ones,arena_allocator<T>(ar));
+            grown=ma+T(0);
+            assert(grown.size()==ma.size() && grown.get_allocator().get_arena()==&ar);
+            assert(std::equal(values.begin(),values.end(),grown.const_begin()));
+        }
+        //parallel check, small grain so chunks get stolen
+        {
+            using simdutils::wrap_add;
+            typedef typename decltype(ma)::multiIdx_t multiIdx_t;
+            const auto &cma=ma;
+            parallel::thread_pool pool(4), single(1);
+            auto pa=ma; //shallow copy, writes should cow
+            parallel::for_each(pa,[](T& x){ x=wrap_add(x,T(1)); },pool,7);
+            assert(std::equal(values.begin(),values.end(),ma.const_begin()));
+            vi=0;
+            for(auto i=pa.const_begin(); i!=pa.const_end(); ++i, ++vi) {
+                assert(*i==wrap_add(values[vi],T(1)));
+            }
+            parallel::transform(ma,pa,[](T x){ return -x; },pool,7);
+            parallel::transform(pa,pa,[](T x){ return -x; },pool,7);
+            assert(std::equal(values.begin(),values.end(),pa.const_begin()));
+            parallel::generate(pa,[&cma](const multiIdx_t& i){ return cma(i); },pool,7);
+            assert(std::equal(values.begin(),values.end(),pa.const_begin()));
+            auto add=[](T a, T b){ return wrap_add(a,b); };
+            T rsum=T(0);
+            for(auto v : values)
+                rsum=wrap_add(rsum,v);
+            T dsum=parallel::reduce(ma,T(0),add,parallel::reduction::deterministic,pool,7);
+            assert(dsum==parallel::reduce(ma,T(0),add,parallel::reduction::deterministic,single,7));
+            assert(simd_close(dsum,rsum));
+            assert(simd_close(parallel::reduce(ma,T(0),add,parallel::reduction::unordered,pool,7),rsum));
+            bool pass=false;
+            try {
+                parallel::for_each(pa,[](T& x){ if(x==x) throw std::runtime_error("stop"); },pool,7);
+            } catch (std::runtime_error &e) {
+                pass=true;
+                assert(std::string(e.what())=="stop");
+            }
+            assert(pass);
+        }
+        //mapped file check
+        {
+            const char* path="multiarray_test.bin";
+            {
+                auto out=io::create_mapped<T,sizeof...(Types)>(path,ma.size());
+                std::copy(values.begin(),values.end(),out.begin());
+            }
+            auto ro=io::map<T,sizeof...(Types)>(path);
+            assert(ro.size()==ma.size());
+            assert(std::equal(values.begin(),values.end(),ro.const_begin()));
+            auto slice=ro.slice(std::tuple_cat(std::make_tuple(range{0}),
+                                               make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type())));
+            assert(std::equal(slice.const_begin(),slice.const_end(),values.begin()));
+            *ro.begin()=T(0); //private to this mapping
+            auto rw=io::map<T,sizeof...(Types)>(path,io::map_mode::read_write);
+            assert(std::equal(values.begin(),values.end(),rw.const_begin()));
+            *rw.begin()=T(1);
+            rw.clear();
+            rw=io::map<T,sizeof...(Types)>(path);
+            assert(*rw.const_begin()==T(1));
+            bool pass=false;
+            try {
+                io::map<char,sizeof...(Types)>(path);
+            } catch (std::runtime_error &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray file type mismatch");
+            }
+            assert(pass);
+            std::remove(path);
+        }
+        //save/load check
+        {
+            const char* path="multiarray_test.bin";
+            for(auto f : {io::format::native,io::format::npy}) {
+                io::save(ma,path,f);
+                auto ld=io::load<T,sizeof...(Types)>(path);
+                assert(ld.size()==ma.size());
+                assert(std::equal(values.begin(),values.end(),ld.const_begin()));
+                assert(std::equal(values.begin(),values.end(),io::map<T,sizeof...(Types)>(path).const_begin()));
+
+                io::writer<T,sizeof...(Types)> out(path,ma.size(),f);
+                for(unsigned int r=0; r<count[0]; r+=3) {
+                    auto rows=range(r,std::min(r+3,count[0])-1);
+                    out.write(ma.slice(std::tuple_cat(std::make_tuple(rows),
+                                                      make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type()))).copy());
+                }
+                assert(out.position()==count[0]);
+                out.close();
+                io::reader<T,sizeof...(Types)> in(path);
+                assert(in.size()==ma.size());
+                decltype(ma) slab;
+                vi=0;
+                while(in.read(slab,2)) {
+                    for(auto i=slab.const_begin(); i!=slab.const_end(); ++i)
+                        assert(*i==values[vi++]);
+                }
+                assert(vi==vi_max);
+                assert(in.position()==count[0]);
+            }
+            bool pass=false;
+            try {
+                io::load<T,sizeof...(Types)+1>(path);
+            } catch (std::runtime_error &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray file type mismatch");
+            }
+            assert(pass);
+            //an extent that doesn't fit an index is rejected, not narrowed
+            io::save(ma,path,io::format::native);
+            {
+                std::fstream patch(path,std::ios::in|std::ios::out|std::ios::binary);
+                std::uint64_t d=(std::uint64_t(1)<<32)+count[0];
+                patch.seekp(sizeof(ioutils::file_header));
+                patch.write(reinterpret_cast<const char*>(&d),sizeof(d));
+            }
+            pass=false;
+            try {
+                io::load<T,sizeof...(Types)>(path);
+            } catch (std::runtime_error &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray file type mismatch");
+            }
+            assert(pass);
+            //NPY dict spacing doesn't matter
+            io::save(ma,path,io::format::npy);
+            {
+                std::ifstream in(path,std::ios::binary);
+                std::string bytes((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+                in.close();
+                std::size_t k=bytes.find(": False,");
+                assert(k!=std::string::npos);
+                bytes.replace(k,8,":False ,");
+                std::ofstream out(path,std::ios::binary|std::ios::trunc);
+                out.write(bytes.data(),bytes.size());
+            }
+            auto spaced=io::load<T,sizeof...(Types)>(path);
+            assert(std::equal(values.begin(),values.end(),spaced.const_begin()));
+            std::remove(path);
+        }
+        //cow policy check
+        {
+            {
+                //begin() and nd_begin() detach once from a copy taken before them
+                const auto snapshot=ma;
+                auto it=ma.begin();
+                *it=-values[0]-1;
+                assert(*snapshot.const_begin()==values[0]);
+                assert(*ma.const_begin()==-values[0]-1);
+                const auto snapshot2=ma;
+                auto nd=ma.nd_begin();
+                *nd=values[0];
+                assert(*snapshot2.const_begin()==-values[0]-1);
+                assert(*ma.const_begin()==values[0]);
+                //iterators cache the buffer: a copy taken after begin() shares
+                //it, so the documented rule is to call begin() again first
+                const auto &cma=ma;
+                it=ma.begin();
+                assert(&*it==cma.data());
+                const auto snapshot3=ma;
+                *it=-values[0]-1;
+                assert(*snapshot3.const_begin()==-values[0]-1);
+                it=ma.begin(); //detaches
+                assert(&*it==cma.data() && cma.data()!=snapshot3.data());
+                *it=values[0];
+                assert(*snapshot3.const_begin()==-values[0]-1);
+                assert(*ma.const_begin()==values[0]);
+                //sorting a copy through its iterators leaves the original alone
+                auto sorted=ma;
+                std::sort(sorted.begin(),sorted.end());
+                assert(std::is_sorted(sorted.const_begin(),sorted.const_end()));
+                assert(std::equal(values.begin(),values.end(),ma.const_begin()));
+            }
+            typedef MultiArray<T,sizeof...(Types),std::allocator<T>,shared_mutable> shared_t;
+            shared_t sm(ma.view());
+            auto sc=sm;
+            const shared_t &csm=sm, &csc=sc;
+            *sc.begin()=T(0); //visible through every copy
+            assert(csm.data()==csc.data());
+            assert(*csm.const_begin()==T(0));
+            sc.reserve_unique(); //detach-once
+            assert(csm.data()!=csc.data());
+            *sc.begin()=T(1);
+            assert(*csm.const_begin()==T(0));
+
+            typedef MultiArray<T,sizeof...(Types),std::allocator<T>,explicit_clone> clone_t;
+            clone_t ec(ma.view());
+            clone_t ed=ec;
+            const clone_t &cec=ec, &ced=ed;
+            assert(cec.data()!=ced.data());
+            *ed.begin()=T(0);
+            assert(std::equal(values.begin(),values.end(),ec.const_begin()));
+            ed=ec;
+            assert(cec.data()!=ced.data());
+            assert(std::equal(values.begin(),values.end(),ed.const_begin()));
+        }
         //copy check
         {
             const auto ca=ma; //shallow copy
@@ -154,6 +574,19 @@ public:
                 assert(std::string(e.what())=="MultiArray index out of range");
             }
             assert(pass);
+            //the full unsigned span is not the whole dimension: out of range,
+            //or rejected where std::size_t can't count it
+            pass=false;
+            try {
+                const range all(0,std::numeric_limits<unsigned int>::max());
+                assert(!all.empty() && all.size()==std::size_t(std::numeric_limits<unsigned int>::max())+1);
+                ma.slice(std::tuple_cat(std::make_tuple(all),make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type())));
+            } catch (std::out_of_range &e) {
+                pass=sizeof(std::size_t)>sizeof(unsigned int);
+            } catch (std::invalid_argument &e) {
+                pass=sizeof(std::size_t)<=sizeof(unsigned int);
+            }
+            assert(pass);
         }
         //move check
         {
@@ -164,7 +597,19 @@ public:
                 assert(*i==values[vi++]);
             }
             assert(vi==vi_max);
-            ma=mva;
+            static_assert(std::is_nothrow_move_constructible<decltype(ma)>::value,"");
+            static_assert(std::is_nothrow_move_assignable<decltype(ma)>::value,"");
+            std::vector<decltype(ma)> batch;
+            const auto &cbatch=batch;
+            batch.push_back(std::move(mva));
+            assert(!mva.valid());
+            const T* p=cbatch[0].data();
+            batch.reserve(batch.capacity()+1); //growth should move, not copy
+            assert(cbatch[0].data()==p);
+            ma=std::move(batch[0]);
+            assert(!batch[0].valid());
+            ma=std::move(ma); //self-move keeps the array
+            assert(ma.valid() && static_cast<const decltype(ma)&>(ma).data()==p);
         }
         //copy-assigment check
         {
@@ -229,6 +674,54 @@ public:
                     vi+=count.back();
                 }
             }
+            //zero-copy view, snapshot on write, copy()
+            {
+                auto slice_arg = make_slice(typename sequtils::gens<sizeof...(Types)>::type());
+                auto view=ma.slice(slice_arg);
+                assert(&*view.const_begin()==&*ma.const_begin());
+                auto copy=view.copy();
+                assert(&*copy.const_begin()!=&*ma.const_begin());
+                vi=0;
+                for(auto i=copy.const_begin(); i!=copy.const_end(); ++i) {
+                    assert(*i==values[vi++]);
+                }
+                assert(vi==vi_max);
+                *ma.begin()=-values[0]-1; //should cow, view keeps old data
+                assert(*view.const_begin()==values[0]);
+                *ma.begin()=values[0];
+            }
+            //non-strided index list in first dimension, gathered
+            {
+                auto slice_arg = make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type());
+                auto slice=ma.slice(std::tuple_cat(std::make_tuple(range{count[0]-1,0}),slice_arg));
+                idx_t inner=size/count[0];
+                vi=0;
+                for(auto i=slice.const_begin(); i!=slice.const_end(); ++i, ++vi) {
+                    assert(*i==values[(idx_t(vi)<inner?count[0]-1:0)*inner+vi%inner]);
+                }
+                assert(idx_t(vi)==2*inner);
+            }
+            //stepped range in first dimension, still a view
+            {
+                auto slice_arg = make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type());
+                range r(1,count[0]-1,2);
+                assert(!r.empty() && r.strided() && r.size()==count[0]/2 && r[1]==3);
+                auto slice=ma.slice(std::tuple_cat(std::make_tuple(r),slice_arg));
+                assert(&*slice.const_begin()==&*ma.const_begin()+size/count[0]);
+                idx_t inner=size/count[0];
+                vi=0;
+                for(auto i=slice.const_begin(); i!=slice.const_end(); ++i, ++vi) {
+                    assert(*i==values[(1+2*(vi/inner))*inner+vi%inner]);
+                }
+                assert(idx_t(vi)==r.size()*inner);
+                bool thrown=false;
+                try {
+                    range(2,1);
+                } catch(std::invalid_argument&) {
+                    thrown=true;
+                }
+                assert(thrown);
+            }
             //no first/last dimension
             {
                 test_slice_2(*this);
@@ -238,6 +731,296 @@ public:
                 test_slice_3(*this);
             }
         }
+        //assign_slice check
+        {
+            auto rest=make_slice2(typename sequtils::gens<sizeof...(Types)-1>::type());
+            idx_t inner=size/count[0];
+            auto block=ma.slice(std::tuple_cat(std::make_tuple(range(0,1)),rest)).copy();
+            auto dst=ma;
+            //strided region, dst shares ma's buffer and must detach
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range(2,3)),rest),block);
+            assert(std::equal(values.begin(),values.end(),ma.const_begin()));
+            vi=0;
+            for(auto i=dst.const_begin(); i!=dst.const_end(); ++i, ++vi) {
+                idx_t row=vi/inner;
+                assert(*i==values[(row==2 || row==3 ? row-2 : row)*inner+vi%inner]);
+            }
+            //source overlapping the destination
+            dst=ma;
+            dst.reserve_unique();
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range(1,2)),rest),dst.slice(std::tuple_cat(std::make_tuple(range(0,1)),rest)));
+            vi=0;
+            for(auto i=dst.const_begin(); i!=dst.const_end(); ++i, ++vi) {
+                idx_t row=vi/inner;
+                assert(*i==values[(row==1 || row==2 ? row-1 : row)*inner+vi%inner]);
+            }
+            //a named source view is a snapshot, the write must not reach it
+            const auto &cdst=dst;
+            auto src1=dst.slice(std::tuple_cat(std::make_tuple(range(1,2)),rest));
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range(0,1)),rest),src1);
+            vi=0;
+            for(auto i=src1.const_begin(); i!=src1.const_end(); ++i, ++vi)
+                assert(*i==values[vi]);
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range(3,4)),rest),dst.slice(std::tuple_cat(std::make_tuple(range(0,1)),rest)));
+            vi=0;
+            for(auto i=dst.const_begin(); i!=dst.const_end(); ++i, ++vi) {
+                idx_t row=vi/inner;
+                assert(*i==values[(row==0 || row==3 ? 0 : row<5 ? 1 : row)*inner+vi%inner]);
+            }
+            //dst itself as the source needs no detach
+            const T* before=cdst.data();
+            dst.assign_slice(make_slice2(typename sequtils::gens<sizeof...(Types)>::type()),dst);
+            assert(cdst.data()==before);
+            //index list, scalar source
+            dst=ma;
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range{4,0,1}),rest),T(-1));
+            vi=0;
+            for(auto i=dst.const_begin(); i!=dst.const_end(); ++i, ++vi) {
+                idx_t row=vi/inner;
+                assert(*i==(row==0 || row==1 || row==4 ? T(-1) : values[vi]));
+            }
+            //index list, array source
+            dst.assign_slice(std::tuple_cat(std::make_tuple(range{4,0}),rest),block);
+            vi=0;
+            for(auto i=dst.const_begin(); i!=dst.const_end(); ++i, ++vi) {
+                idx_t row=vi/inner;
+                assert(*i==(row==4 ? values[vi%inner] : row==0 ? values[inner+vi%inner] : row==1 ? T(-1) : values[vi]));
+            }
+            bool thrown=false;
+            try {
+                dst.assign_slice(std::tuple_cat(std::make_tuple(range(0,2)),rest),block);
+            } catch(std::invalid_argument&) {
+                thrown=true;
+            }
+            assert(thrown);
+        }
+        //transpose check
+        {
+            auto t=ma.transpose();
+            for(auto i=ma.const_begin(); i!=ma.const_end(); ++i) {
+                auto r=i.index();
+                std::reverse(r.begin(),r.end());
+                assert(t(r)==*i);
+            }
+            auto tc=t.copy();
+            auto r=tc.size();
+            std::reverse(r.begin(),r.end());
+            assert(r==ma.size());
+            assert(std::equal(tc.const_begin(),tc.const_end(),t.const_begin()));
+            auto back=tc.transpose().copy();
+            assert(std::equal(values.begin(),values.end(),back.const_begin()));
+            auto rot=rotate(ma.view(),typename sequtils::gens<sizeof...(Types)>::type());
+            auto rc=rot.copy();
+            for(auto i=rc.const_begin(); i!=rc.const_end(); ++i) {
+                auto idx=i.index(), src=idx;
+                for(unsigned int j=0; j<sizeof...(Types); ++j)
+                    src[(j+1)%sizeof...(Types)]=idx[j];
+                assert(*i==ma(src));
+            }
+        }
+        //layout check
+        {
+            typedef typename decltype(ma)::layout_t layout_t;
+            auto cm=make_array<T>(layout_t::column_major(),ma.size());
+            for(auto i=ma.const_begin(); i!=ma.const_end(); ++i)
+                cm(i.index())=*i;
+            assert(cm.get_layout()==layout_t::column_major());
+            assert(cm.stride(0)==1);
+            //iteration follows memory order, the first index runs fastest
+            idx_t n=0;
+            for(auto i=cm.const_begin(); i!=cm.const_end(); ++i, ++n) {
+                assert(*i==ma(i.index()));
+                assert(&*i==cm.data()+n);
+            }
+            auto rm=cm.view().copy();
+            assert(std::equal(values.begin(),values.end(),rm.const_begin()));
+            //mixed layouts fall back to multi-index evaluation, small values
+            //so int arithmetic can't overflow
+            auto small=ma.view().copy();
+            for(auto &x : small)
+                x=T(std::rand()%1000);
+            auto small_cm=make_array<T>(layout_t::column_major(),ma.size());
+            for(auto i=small.const_begin(); i!=small.const_end(); ++i)
+                small_cm(i.index())=*i;
+            decltype(ma) mixed=small+small_cm;
+            assert(mixed.get_layout()==layout_t::row_major());
+            decltype(ma) same=small_cm+small_cm*T(2);
+            assert(same.get_layout()==layout_t::column_major());
+            for(auto i=small.const_begin(); i!=small.const_end(); ++i) {
+                assert(mixed(i.index())==T(*i+*i));
+                assert(same(i.index())==T(*i+*i*T(2)));
+            }
+            bool pass=sizeof...(Types)==1; //one axis has a single order
+            try {
+                simd::dot(ma,cm);
+            } catch (std::invalid_argument &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray layout mismatch");
+            }
+            assert(pass);
+            auto gen=make_array<T>(layout_t::column_major(),ma.size());
+            parallel::thread_pool pool(4);
+            parallel::generate(gen,[this](const std::array<unsigned int,sizeof...(Types)>& idx) { return ma(idx); },pool,7);
+            assert(std::equal(cm.const_begin(),cm.const_end(),gen.const_begin()));
+
+            const char* path="multiarray_test.bin";
+            io::save(cm,path,io::format::npy);
+            auto ld=io::load<T,sizeof...(Types)>(path);
+            assert(ld.get_layout()==cm.get_layout());
+            assert(std::equal(cm.const_begin(),cm.const_end(),ld.const_begin()));
+            io::save(cm,path);
+            ld=io::load<T,sizeof...(Types)>(path);
+            assert(ld.get_layout()==layout_t::row_major());
+            assert(std::equal(values.begin(),values.end(),ld.const_begin()));
+            std::remove(path);
+        }
+        //external buffer check
+        {
+            std::vector<T> buf(values);
+            decltype(ma) ext(ma.size(),buf.data());
+            assert(ext.data()==buf.data());
+            assert(std::equal(values.begin(),values.end(),ext.const_begin()));
+            ext(ext.const_begin().index())=T(7);
+            assert(buf[0]==T(7));
+            auto back=ext.release();
+            assert(back.get()==buf.data());
+            assert(!ext.valid());
+
+            int deleted=0;
+            {
+                T* p=new T[size]();
+                decltype(ma) owned(ma.size(),p,[&deleted](T* q) { delete[] q; ++deleted; });
+                auto cp=owned;
+                owned=decltype(ma)();
+                assert(!deleted && cp.data()==p);
+            }
+            assert(deleted==1);
+
+            std::shared_ptr<T> sp(new T[size](),std::default_delete<T[]>());
+            const decltype(ma) shared(ma.size(),sp);
+            assert(shared.data()==sp.get());
+
+            std::vector<T> fortran(size);
+            for(auto i=ma.const_begin(); i!=ma.const_end(); ++i) {
+                idx_t off=0;
+                for(unsigned int j=sizeof...(Types); j-->0;)
+                    off=off*count[j]+i.index()[j];
+                fortran[off]=*i;
+            }
+            decltype(ma) fa(layout<sizeof...(Types)>::column_major(),ma.size(),fortran.data());
+            assert(std::equal(values.begin(),values.end(),fa.view().copy().const_begin()));
+        }
+        //reshape check
+        {
+            const auto &cma=ma;
+            const auto flat=ma.flatten();
+            assert(flat.size()[0]==size && flat.data()==cma.data());
+            assert(std::equal(values.begin(),values.end(),flat.const_begin()));
+            const auto two=ma.template reshape<2>(1u,size);
+            assert(two.data()==cma.data() && two.get(0,size-1)==values[size-1]);
+            const auto back=flat.reshape(ma.size());
+            assert(back.size()==ma.size() && back.data()==cma.data());
+            auto cp=ma.flatten(); //writes detach from ma
+            cp(0)=values[0]+T(1);
+            assert(cma.data()[0]==values[0]);
+            //other policies: shared_mutable aliases, explicit_clone copies
+            typedef MultiArray<T,sizeof...(Types),std::allocator<T>,shared_mutable> shared_t;
+            shared_t sm(ma.view());
+            auto smf=sm.flatten();
+            const shared_t& csm=sm;
+            smf(0)=-values[0]-1;
+            assert(smf.data()==csm.data() && *csm.const_begin()==-values[0]-1);
+            typedef MultiArray<T,sizeof...(Types),std::allocator<T>,explicit_clone> clone_t;
+            clone_t ec(ma.view());
+            auto ecf=ec.flatten();
+            const clone_t& cec=ec;
+            ecf(0)=-values[0]-1;
+            assert(ecf.data()!=cec.data() && *cec.const_begin()==values[0]);
+            assert(std::equal(values.begin()+1,values.end(),ecf.const_begin()+1));
+            auto cm=make_array<T>(layout<sizeof...(Types)>::column_major(),ma.size());
+            cm=ma+T(0);
+            const auto cmf=cm.flatten();
+            assert(std::equal(cm.const_begin(),cm.const_end(),cmf.const_begin()));
+            //custom layouts go through a dense copy, still from the array's allocator
+            std::array<unsigned int,sizeof...(Types)> order;
+            for(unsigned int k=0; k<order.size(); ++k)
+                order[k]=(k+1)%order.size();
+            arena ar(4096);
+            MultiArray<T,sizeof...(Types),arena_allocator<T> > ca(layout<sizeof...(Types)>(order),ma.size(),arena_allocator<T>(ar));
+            ca=ma+T(0);
+            const auto caf=ca.flatten();
+            assert(caf.get_allocator().get_arena()==&ar);
+            if(sizeof...(Types)>2) //otherwise the rotation is row- or column-major
+                assert(std::equal(values.begin(),values.end(),caf.const_begin()));
+            bool pass=false;
+            try {
+                ma.template reshape<2>(2u,size);
+            } catch (std::invalid_argument &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray shape mismatch");
+            }
+            assert(pass);
+        }
+        //broadcast check
+        {
+            const unsigned int nd=sizeof...(Types);
+            //small values, so int arithmetic can't overflow
+            auto sm=ma.view().copy();
+            for(auto &x : sm)
+                x=T(std::rand()%1000);
+            MultiArray<T,1> bias(count[nd-1]);
+            for(unsigned int k=0; k<count[nd-1]; ++k)
+                bias(k)=T(k%7);
+            decltype(sm) res=sm+bias;
+            auto cp=sm;
+            cp-=bias;
+            std::array<unsigned int,nd> ones;
+            ones.fill(1);
+            ones[0]=count[0];
+            auto col=make_array<T>(ones);
+            for(unsigned int k=0; k<count[0]; ++k) {
+                auto idx=ones;
+                idx.fill(0);
+                idx[0]=k;
+                col(idx)=T(k%5);
+            }
+            decltype(sm) scaled=col*sm;
+            const auto bv=bias.broadcast(sm.size());
+            const auto bc=bv.copy();
+            for(auto i=sm.const_begin(); i!=sm.const_end(); ++i) {
+                auto idx=i.index();
+                assert(res(idx)==T(*i+bias(idx[nd-1])));
+                assert(cp(idx)==T(*i-bias(idx[nd-1])));
+                assert(scaled(idx)==T(T(idx[0]%5)**i));
+                assert(bv(idx)==bias(idx[nd-1]) && bc(idx)==bias(idx[nd-1]));
+            }
+            bool pass=false;
+            try {
+                MultiArray<T,1> wrong(count[nd-1]+1);
+                res=sm+wrong;
+            } catch (std::invalid_argument &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray shape mismatch");
+            }
+            assert(pass);
+            //compound assignment keeps the left shape, it doesn't broadcast up
+            ones.fill(1);
+            auto one=make_array<T>(ones);
+            *one.begin()=T(3);
+            pass=false;
+            try {
+                one+=sm;
+            } catch (std::invalid_argument &e) {
+                pass=true;
+                assert(std::string(e.what())=="MultiArray shape mismatch");
+            }
+            assert(pass);
+            assert(one.size()==ones && *one.const_begin()==T(3));
+        }
+        //axis reduction check
+        {
+            test_reduce(*this);
+        }
         //logic_error check
         {
             auto mva=std::move(ma);
@@ -255,6 +1038,210 @@ public:
     }
 };
 
+template<typename T, unsigned int ... Dims>
+void test_fixed() {
+    typedef FixedMultiArray<T,Dims...> F;
+    static_assert(F::flat_size()==fixedutils::product<Dims...>::value,"");
+    static_assert(F::template stride<sizeof...(Dims)-1>()==1,"");
+    MultiArray<T,sizeof...(Dims)> ma(Dims...);
+    assert(F::size()==ma.size());
+    for(auto &i : ma)
+        i=std::rand();
+    F fa;
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i)
+        fa(i.index())=*i;
+    const F cfa=fa; //deep copy
+    fa(ma.const_begin().index())=T(0);
+    auto p=cfa.data();
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i, ++p) {
+        assert(cfa(i.index())==*i);
+        assert(cfa.at_unchecked(i.index())==*i);
+        assert(*p==*i);
+    }
+    assert(fa(ma.const_begin().index())==T(0));
+    bool pass=false;
+    try {
+        typename F::multiIdx_t idx=F::size();
+        fa(idx)=T(0);
+    } catch (std::out_of_range &e) {
+        pass=true;
+        assert(std::string(e.what())=="MultiArray index out of range");
+    }
+    assert(pass);
+    //every index is checked, not only the flat offset
+    pass=false;
+    try {
+        typename F::multiIdx_t idx{{0}};
+        idx.back()=F::size().back();
+        cfa(idx);
+    } catch (std::out_of_range &) {
+        pass=true;
+    }
+    assert(pass);
+    //iterators walk row-major like MultiArray's and know their index
+    auto j=ma.const_begin();
+    for(auto i=cfa.const_begin(); i!=cfa.const_end(); ++i, ++j) {
+        assert(*i==*j);
+        assert(i.index()==j.index());
+    }
+    assert(std::equal(cfa.begin(),cfa.end(),ma.const_begin()));
+    assert(cfa.end()-cfa.begin()==typename F::iterator::difference_type(F::flat_size()));
+    for(auto &x : fa)
+        x=T(1);
+    assert(std::count(fa.const_begin(),fa.const_end(),T(1))==typename F::iterator::difference_type(F::flat_size()));
+    //views and slices are snapshots that own their data
+    auto v=cfa.view();
+    assert(&*v.const_begin()!=cfa.data());
+    assert(std::equal(v.const_begin(),v.const_end(),ma.const_begin()));
+    F tmp(cfa);
+    auto tv=tmp.view();
+    tmp.fill(T(0));
+    assert(std::equal(tv.const_begin(),tv.const_end(),ma.const_begin()));
+    auto outlived=F(cfa).slice(std::make_tuple(range(0,Dims-1)...));
+    assert(std::equal(outlived.const_begin(),outlived.const_end(),ma.const_begin()));
+    auto inner=std::make_tuple(range(1,Dims-1)...);
+    auto fs=cfa.slice(inner), ms=ma.slice(inner);
+    assert(fs.size()==ms.size());
+    assert(std::equal(fs.const_begin(),fs.const_end(),ms.const_begin()));
+}
+
+template<typename T, unsigned int ... Dims>
+void test_sparse() {
+    typedef SparseMultiArray<T,sizeof...(Dims)> S;
+    MultiArray<T,sizeof...(Dims)> ma(Dims...);
+    for(auto &i : ma)
+        i=std::rand()%10==0 ? T(std::rand()%100+1) : T(0);
+    //coo in reverse order, with a stale entry overwritten by a later one
+    typename S::coo entries(ma.size());
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i)
+        entries.add(i.index(),T(-1));
+    std::vector<typename S::multiIdx_t> idx;
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i)
+        idx.push_back(i.index());
+    for(auto i=idx.rbegin(); i!=idx.rend(); ++i)
+        entries.add(*i,ma(*i));
+    S sa(entries);
+    typename S::idx_t n=0;
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i) {
+        assert(sa(i.index())==*i);
+        n+=*i!=T(0);
+    }
+    assert(sa.nnz()==n);
+    assert(sa.size()==ma.size());
+    typename S::idx_t visited=0;
+    for(auto i=sa.const_begin(); i!=sa.const_end(); ++i, ++visited) {
+        assert(*i!=T(0));
+        assert(*i==ma(i.index()));
+    }
+    assert(visited==n);
+    auto dense=sa.to_dense();
+    assert(std::equal(dense.const_begin(),dense.const_end(),ma.const_begin()));
+    const S from_dense(ma);
+    assert(from_dense.nnz()==n);
+    //set inserts, overwrites and erases
+    auto first=ma.const_begin().index(), last=idx.back();
+    sa.set(first,T(7));
+    sa.set(last,T(8));
+    assert(sa(first)==T(7) && sa(last)==T(8));
+    sa.set(first,T(0));
+    assert(sa(first)==T(0));
+    assert(sa.nnz()==n+(ma(last)==T(0) ? 1 : 0)-(ma(first)==T(0) ? 0 : 1));
+    //elements spread over many blocks
+    SparseMultiArray<T,1> big(1u<<20);
+    const unsigned int at[]={5,4095,4096,100000,1u<<19,(1u<<20)-1};
+    for(auto i : at)
+        big.set({{i}},T(i%97+1));
+    big.set({{100000}},T(0));
+    assert(big.nnz()==5 && big(100000u)==T(0) && big(4096u)==T(4096%97+1));
+    typename S::idx_t found=0;
+    for(auto i=big.const_begin(); i!=big.const_end(); ++i, ++found)
+        assert(*i==T(i.index()[0]%97+1) && i.index()[0]!=100000);
+    assert(found==5);
+    auto bd=big.to_dense();
+    assert(bd(4095u)==T(4095%97+1) && bd(4094u)==T(0) && std::count(bd.const_begin(),bd.const_end(),T(0))==(1<<20)-5);
+    bool pass=false;
+    try {
+        sa.get(sa.size());
+    } catch (std::out_of_range &e) {
+        pass=true;
+        assert(std::string(e.what())=="MultiArray index out of range");
+    }
+    assert(pass);
+}
+
+template<typename T, unsigned int ... Dims>
+void test_blocked() {
+    typedef BlockedMultiArray<T,sizeof...(Dims),4> B;
+    MultiArray<T,sizeof...(Dims)> ma(Dims...);
+    for(auto &i : ma)
+        i=std::rand();
+    B ba(ma);
+    const B& cba=ba;
+    assert(cba.size()==ma.size() && cba.flat_size()==ma.flat_size());
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i)
+        assert(cba(i.index())==*i);
+    auto dense=cba.to_dense();
+    assert(std::equal(dense.const_begin(),dense.const_end(),ma.const_begin()));
+    //iterators visit every element once, chunk by chunk
+    std::vector<bool> seen(ma.flat_size());
+    typename B::idx_t n=0;
+    for(auto i=cba.const_begin(); i!=cba.const_end(); ++i, ++n) {
+        assert(*i==ma(i.index()));
+        auto idx=i.index();
+        typename B::idx_t flat=0;
+        for(unsigned int j=0; j<sizeof...(Dims); ++j)
+            flat=flat*ma.size()[j]+idx[j];
+        assert(!seen[flat]);
+        seen[flat]=true;
+    }
+    assert(n==ma.flat_size());
+    //chunk traversal covers the array, data laid out by chunk_stride
+    n=0;
+    cba.for_each_chunk([&](const typename B::multiIdx_t& origin, const typename B::multiIdx_t& ext, const T* data) {
+        typename B::multiIdx_t l{{0}};
+        for(;;) {
+            typename B::multiIdx_t idx;
+            typename B::idx_t off=0;
+            for(unsigned int j=0; j<sizeof...(Dims); ++j) {
+                idx[j]=origin[j]+l[j];
+                off+=l[j]*B::chunk_stride(j);
+            }
+            assert(data[off]==ma(idx));
+            ++n;
+            unsigned int j=sizeof...(Dims);
+            for(; j-->0;) {
+                if(++l[j]<ext[j])
+                    break;
+                l[j]=0;
+            }
+            if(j==unsigned(-1))
+                break;
+        }
+    });
+    assert(n==ma.flat_size());
+    for(auto &x : ba)
+        x=T(1);
+    ba.for_each_chunk([](const typename B::multiIdx_t&, const typename B::multiIdx_t&, T* data) { data[0]=T(2); });
+    assert(cba.get(typename B::multiIdx_t{{0}})==T(2));
+    assert(std::count(cba.const_begin(),cba.const_end(),T(1))+std::count(cba.const_begin(),cba.const_end(),T(2))==std::ptrdiff_t(ma.flat_size()));
+    //slices come back dense and match MultiArray's
+    ba=B(ma);
+    auto inner=std::make_tuple(range(1,Dims-1,2)...);
+    auto bs=cba.slice(inner);
+    auto ms=ma.slice(inner);
+    assert(bs.size()==ms.size());
+    assert(std::equal(bs.const_begin(),bs.const_end(),ms.const_begin()));
+    bool pass=false;
+    try {
+        typename B::multiIdx_t idx=cba.size();
+        ba(idx)=T(0);
+    } catch (std::out_of_range &e) {
+        pass=true;
+        assert(std::string(e.what())=="MultiArray index out of range");
+    }
+    assert(pass);
+}
+
 #endif // TEST_H
 
 template<typename T,typename ... Types>
@@ -307,3 +1294,84 @@ void test_slice_3(Test<T,Types...> &test) {
         }
     }
 }
+
+template<unsigned int axis, typename A>
+std::array<unsigned int,std::tuple_size<A>::value-1> drop_axis(const A& idx) {
+    std::array<unsigned int,std::tuple_size<A>::value-1> r;
+    for(unsigned int j=0, k=0; j<idx.size(); ++j)
+        if(j!=axis)
+            r[k++]=idx[j];
+    return r;
+}
+
+template<typename T,typename ... Types>
+void test_reduce(Test<T,Types...> &test) {
+    const unsigned int nd=sizeof...(Types);
+    //small values, so int sums can't overflow
+    auto ma=test.ma.view().copy();
+    for(auto &x : ma)
+        x=T(std::rand()%1000);
+    auto s0=ma.template sum<0>();
+    auto mx=ma.template max<nd-1>();
+    auto mn=ma.template min<0>();
+    auto am=ma.template argmax<0>();
+    auto mean=ma.template mean<nd-1>();
+    auto ref0=make_array<T>(s0.size());
+    auto refmx=make_array<T>(mx.size());
+    for(auto i=ma.const_begin(); i!=ma.const_end(); ++i) {
+        auto idx=i.index();
+        auto k0=drop_axis<0>(idx), kl=drop_axis<nd-1>(idx);
+        ref0(k0)=idx[0] ? T(ref0(k0)+*i) : *i;
+        refmx(kl)=idx[nd-1] && refmx(kl)>=*i ? refmx(kl) : *i;
+        assert(mn(k0)<=*i);
+        auto best=idx;
+        best[0]=am(k0);
+        assert(*i<=ma(best) && (*i!=ma(best) || best[0]<=idx[0]));
+    }
+    assert(std::equal(ref0.const_begin(),ref0.const_end(),s0.const_begin()));
+    assert(std::equal(refmx.const_begin(),refmx.const_end(),mx.const_begin()));
+    auto sl=ma.template sum<nd-1>();
+    for(auto i=mean.const_begin(); i!=mean.const_end(); ++i)
+        assert(*i==T(sl(i.index())/T(test.count[nd-1])));
+
+    parallel::thread_pool pool(4);
+    auto p0=parallel::reduce<0>(ma,std::plus<T>(),pool,7);
+    assert(std::equal(s0.const_begin(),s0.const_end(),p0.const_begin()));
+    auto pl=parallel::reduce<nd-1>(ma,std::plus<T>(),pool,7);
+    assert(std::equal(sl.const_begin(),sl.const_end(),pl.const_begin()));
+
+    //other layouts reduce in memory order and keep the remaining axes' order
+    auto cm=make_array<T>(layout<nd>::column_major(),ma.size());
+    cm=ma+T(0);
+    auto cmax=cm.template max<nd-1>();
+    assert(cmax.get_layout()==layout<nd-1>::column_major());
+    for(auto i=mx.const_begin(); i!=mx.const_end(); ++i)
+        assert(cmax(i.index())==*i);
+    //the parallel result keeps allocator, policy and the reduced layout
+    MultiArray<T,nd,aligned_allocator<T>,explicit_clone> al;
+    al=cm+T(0);
+    auto pal=parallel::reduce<nd-1>(al,[](T x, T y) { return std::max(x,y); },pool,7);
+    static_assert(std::is_same<decltype(pal),MultiArray<T,nd-1,aligned_allocator<T>,explicit_clone> >::value,"");
+    assert(pal.get_layout()==layout<nd-1>::column_major());
+    for(auto i=mx.const_begin(); i!=mx.const_end(); ++i)
+        assert(pal(i.index())==*i);
+    //results live in the source's arena, not in the one bound at the call
+    arena ar(4096), other(4096);
+    typedef MultiArray<T,nd,arena_allocator<T> > arena_t;
+    arena_t aa;
+    {
+        arena_scope scope(ar);
+        aa=arena_t(ma.view());
+    }
+    auto as=aa.template sum<0>();
+    assert(as.get_allocator().get_arena()==&ar);
+    assert(std::equal(s0.const_begin(),s0.const_end(),as.const_begin()));
+    arena_scope scope(other);
+    auto aam=aa.template argmax<0>();
+    static_assert(std::is_same<decltype(aam.get_allocator()),arena_allocator<unsigned int> >::value,"");
+    assert(aam.get_allocator().get_arena()==&ar);
+    assert(std::equal(am.const_begin(),am.const_end(),aam.const_begin()));
+    auto pas=parallel::reduce<0>(aa,std::plus<T>(),pool,7);
+    assert(pas.get_allocator().get_arena()==&ar);
+    assert(std::equal(s0.const_begin(),s0.const_end(),pas.const_begin()));
+}